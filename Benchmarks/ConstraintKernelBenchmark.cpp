@@ -0,0 +1,104 @@
+// Compares residual and Jacobian evaluation through one virtual Constraint
+// call per row against the type-grouped batches the solver uses.
+//
+//   ConstraintKernelBenchmark [constraints] [repeats]
+
+#include "../ConstraintSolver/ConstraintBatch.h"
+#include "../ConstraintSolver/DistanceConstraint.h"
+#include "../ConstraintSolver/HorizontalConstraint.h"
+#include "../GeometryEngine/ParameterStore.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double nanosecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    const size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const int repeats = argc > 2 ? std::stoi(argv[2]) : 50;
+
+    // A zig-zag chain: every link has a distance and a horizontal constraint.
+    ParameterStore store;
+    std::vector<std::shared_ptr<Point>> points;
+    points.reserve(count + 1);
+    for (size_t i = 0; i <= count; ++i) {
+        auto p = std::make_shared<Point>(static_cast<double>(i), (i % 2) ? 0.5 : 0.0);
+        p->adoptParameters(store);
+        points.push_back(p);
+    }
+
+    ParameterIndexMap indices;
+    for (const auto& p : points) {
+        p->forEachParameter([&](double* param) {
+            indices.emplace(param, ParameterBinding{ static_cast<int>(indices.size()), param });
+        });
+    }
+
+    std::vector<std::shared_ptr<Constraint>> constraints;
+    constraints.reserve(2 * count);
+    for (size_t i = 0; i < count; ++i) {
+        constraints.push_back(std::make_shared<DistanceConstraint>(points[i], points[i + 1], 1.0));
+        constraints.push_back(std::make_shared<HorizontalConstraint>(points[i], points[i + 1]));
+    }
+
+    ConstraintBatch distances(ConstraintKernel::Distance);
+    ConstraintBatch horizontals(ConstraintKernel::Horizontal);
+    for (auto& c : constraints) {
+        c->bindParameters(indices);
+        (c->kernel() == ConstraintKernel::Distance ? distances : horizontals).add(c->kernelTerm());
+    }
+
+    std::vector<double> residuals(constraints.size());
+    double checksum = 0.0;
+
+    auto start = Clock::now();
+    GradientRow row;
+    for (int rep = 0; rep < repeats; ++rep) {
+        for (size_t i = 0; i < constraints.size(); ++i) {
+            residuals[i] = constraints[i]->evaluate();
+            row.clear();
+            constraints[i]->getGradient(row);
+            for (int k = 0; k < row.size; ++k) checksum += row.values[k];
+        }
+        checksum += residuals[rep % residuals.size()];
+    }
+    const double virtualNs = nanosecondsSince(start) / (repeats * constraints.size());
+
+    start = Clock::now();
+    for (int rep = 0; rep < repeats; ++rep) {
+        distances.evaluate(residuals.data(), true);
+        horizontals.evaluate(residuals.data() + distances.size(), true);
+        for (const ConstraintBatch* batch : { &distances, &horizontals }) {
+            for (size_t t = 0; t < batch->size(); ++t) {
+                for (int k = 0; k < 4; ++k) {
+                    if (batch->column(t, k) >= 0) checksum += batch->partial(t, k);
+                }
+            }
+        }
+        checksum += residuals[rep % residuals.size()];
+    }
+    const double batchedNs = nanosecondsSince(start) / (repeats * constraints.size());
+
+#if defined(__AVX2__)
+    const char* isa = "avx2";
+#elif defined(__SSE2__)
+    const char* isa = "sse2";
+#else
+    const char* isa = "scalar";
+#endif
+
+    std::cout << "constraints,repeats,isa,virtual_ns_per_row,batched_ns_per_row,speedup,checksum\n"
+              << constraints.size() << ',' << repeats << ',' << isa << ','
+              << virtualNs << ',' << batchedNs << ',' << virtualNs / batchedNs << ',' << checksum << '\n';
+    return 0;
+}
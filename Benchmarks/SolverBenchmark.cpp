@@ -0,0 +1,346 @@
+// Times Solver::solve() on generated sketches of increasing size and prints
+// one machine-readable record per configuration. Runs without a display.
+//
+//   SolverBenchmark [--min-params N] [--max-params N] [--repeats N]
+//                   [--algorithm gn|lm|dogleg] [--threads N] [--format csv|json]
+//                   [--generator chain|grid|frames]
+//
+// Sizes step by factors of ten from --min-params (100) to --max-params (1M).
+// Peak memory is the process high-water mark, so configurations run from the
+// smallest up and each value bounds that configuration's own peak.
+
+#include "../ConstraintSolver/Solver.h"
+#include "../ConstraintSolver/CoincidentConstraint.h"
+#include "../ConstraintSolver/DistanceConstraint.h"
+#include "../ConstraintSolver/HorizontalConstraint.h"
+#include "../GeometryEngine/ParameterStore.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+size_t peakResidentKilobytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024; // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// A generated sketch: points packed in a store, the constraints between them
+// and the parameters the solver may move.
+struct System {
+    ParameterStore store;
+    std::vector<std::shared_ptr<Point>> points;
+    std::vector<std::shared_ptr<Constraint>> constraints;
+
+    std::shared_ptr<Point> addPoint(double x, double y) {
+        auto point = std::make_shared<Point>(x, y);
+        point->adoptParameters(store);
+        points.push_back(point);
+        return point;
+    }
+
+    ~System() {
+        for (auto& point : points) point->releaseParameters(store);
+    }
+};
+
+// Every generator builds a solvable sketch and starts it a few percent away
+// from a solution, the way a drag leaves it.
+class Perturbation {
+public:
+    explicit Perturbation(unsigned seed) : m_random(seed), m_offset(-0.05, 0.05) {}
+    double operator()(double value) { return value + m_offset(m_random); }
+
+private:
+    std::mt19937 m_random;
+    std::uniform_real_distribution<double> m_offset;
+};
+
+// A zig-zag polyline of unit-length links.
+void buildChain(System& system, size_t parameters) {
+    Perturbation jitter(1);
+    const size_t count = std::max<size_t>(parameters / 2, 2);
+    for (size_t i = 0; i < count; ++i) {
+        auto p = system.addPoint(jitter(0.8 * static_cast<double>(i)), jitter((i % 2) ? 0.6 : 0.0));
+        if (i > 0) system.constraints.push_back(std::make_shared<DistanceConstraint>(system.points[i - 1], p, 1.0));
+    }
+}
+
+// A square lattice drawn as separate unit segments whose endpoints are tied
+// together with coincident constraints at every node; horizontal segments
+// also carry a horizontal constraint.
+void buildGrid(System& system, size_t parameters) {
+    Perturbation jitter(2);
+    // Each cell contributes two segments, i.e. four points and eight
+    // parameters.
+    const size_t side = std::max<size_t>(2, static_cast<size_t>(std::sqrt(static_cast<double>(parameters) / 8.0)) + 1);
+
+    std::vector<std::shared_ptr<Point>> node(side * side);
+    auto attach = [&](size_t r, size_t c, const std::shared_ptr<Point>& p) {
+        auto& anchor = node[r * side + c];
+        if (anchor) system.constraints.push_back(std::make_shared<CoincidentConstraint>(anchor, p));
+        else anchor = p;
+    };
+
+    for (size_t r = 0; r < side; ++r) {
+        for (size_t c = 0; c < side; ++c) {
+            const double x = static_cast<double>(c);
+            const double y = static_cast<double>(r);
+            if (c + 1 < side) {
+                auto a = system.addPoint(jitter(x), jitter(y));
+                auto b = system.addPoint(jitter(x + 1.0), jitter(y));
+                system.constraints.push_back(std::make_shared<DistanceConstraint>(a, b, 1.0));
+                system.constraints.push_back(std::make_shared<HorizontalConstraint>(a, b));
+                attach(r, c, a);
+                attach(r, c + 1, b);
+            }
+            if (r + 1 < side) {
+                auto a = system.addPoint(jitter(x), jitter(y));
+                auto b = system.addPoint(jitter(x), jitter(y + 1.0));
+                system.constraints.push_back(std::make_shared<DistanceConstraint>(a, b, 1.0));
+                attach(r, c, a);
+                attach(r + 1, c, b);
+            }
+        }
+    }
+}
+
+// Many independent rectangles, each rigid up to translation: four sides, a
+// diagonal and horizontal top and bottom edges. Exercises clustering and the
+// parallel path.
+void buildFrames(System& system, size_t parameters) {
+    Perturbation jitter(3);
+    const size_t frames = std::max<size_t>(parameters / 8, 1);
+    const double width = 2.0;
+    const double height = 1.0;
+    for (size_t f = 0; f < frames; ++f) {
+        const double x = 3.0 * static_cast<double>(f % 1000);
+        const double y = 2.0 * static_cast<double>(f / 1000);
+        auto a = system.addPoint(jitter(x), jitter(y));
+        auto b = system.addPoint(jitter(x + width), jitter(y));
+        auto c = system.addPoint(jitter(x + width), jitter(y + height));
+        auto d = system.addPoint(jitter(x), jitter(y + height));
+
+        auto& cs = system.constraints;
+        cs.push_back(std::make_shared<DistanceConstraint>(a, b, width));
+        cs.push_back(std::make_shared<DistanceConstraint>(b, c, height));
+        cs.push_back(std::make_shared<DistanceConstraint>(c, d, width));
+        cs.push_back(std::make_shared<DistanceConstraint>(d, a, height));
+        cs.push_back(std::make_shared<DistanceConstraint>(a, c, std::hypot(width, height)));
+        cs.push_back(std::make_shared<HorizontalConstraint>(a, b));
+        cs.push_back(std::make_shared<HorizontalConstraint>(d, c));
+    }
+}
+
+struct Generator {
+    const char* name;
+    void (*build)(System&, size_t);
+};
+
+const Generator Generators[] = {
+    { "chain", buildChain },
+    { "grid", buildGrid },
+    { "frames", buildFrames },
+};
+
+struct Result {
+    std::string generator;
+    size_t parameters = 0;
+    size_t constraints = 0;
+    Solver::Status status = Solver::Status::Failed;
+    int iterations = 0;     // summed over clusters
+    int maxIterations = 0;  // of the slowest cluster
+    double residual = 0.0;  // ||r|| after the solve
+    double seconds = 0.0;   // best of the repeats
+    Solver::Report report;  // of the best repeat
+    size_t peakKilobytes = 0;
+    double exponent = 0.0;  // log-log slope of time against the previous size
+};
+
+Result run(const Generator& generator, size_t parameters, const Solver::Options& options,
+           unsigned threads, int repeats) {
+    Result result;
+    result.generator = generator.name;
+    result.seconds = -1.0;
+
+    for (int rep = 0; rep < repeats; ++rep) {
+        System system;
+        generator.build(system, parameters);
+
+        Solver solver;
+        solver.setOptions(options);
+        solver.setThreadCount(threads);
+        for (const auto& point : system.points) {
+            point->forEachParameter([&](double* param) { solver.addParameter(param); });
+        }
+        for (const auto& constraint : system.constraints) solver.addConstraint(constraint);
+
+        const auto start = Clock::now();
+        Solver::Status status = solver.solve();
+        const double seconds = secondsSince(start);
+        if (result.seconds >= 0.0 && seconds >= result.seconds) continue;
+
+        result.seconds = seconds;
+        result.status = status;
+        result.report = solver.report();
+        result.parameters = 2 * system.points.size();
+        result.constraints = system.constraints.size();
+        result.iterations = 0;
+        result.maxIterations = 0;
+        for (const auto& cluster : solver.clusters()) {
+            result.iterations += cluster.iterations;
+            result.maxIterations = std::max(result.maxIterations, cluster.iterations);
+        }
+        double squared = 0.0;
+        for (const auto& constraint : system.constraints) {
+            const double r = constraint->evaluate();
+            squared += r * r;
+        }
+        result.residual = std::sqrt(squared);
+    }
+
+    result.peakKilobytes = peakResidentKilobytes();
+    return result;
+}
+
+const char* algorithmName(Solver::Algorithm algorithm) {
+    switch (algorithm) {
+        case Solver::Algorithm::GaussNewton:        return "gn";
+        case Solver::Algorithm::LevenbergMarquardt: return "lm";
+        case Solver::Algorithm::Dogleg:             return "dogleg";
+    }
+    return "unknown";
+}
+
+void printCsvHeader() {
+    std::cout << "generator,algorithm,parameters,constraints,clusters,eliminated_parameters,nonzeros,"
+                 "status,iterations,max_cluster_iterations,residual,seconds,prepare_seconds,"
+                 "evaluation_seconds,assembly_seconds,factorization_seconds,peak_kb,time_exponent\n";
+}
+
+void printCsv(const Result& r, Solver::Algorithm algorithm) {
+    const auto& report = r.report;
+    std::cout << r.generator << ',' << algorithmName(algorithm) << ',' << r.parameters << ',' << r.constraints << ','
+              << report.clusterCount << ',' << report.eliminatedParameters << ',' << report.nonZeros << ','
+              << Solver::toString(r.status) << ',' << r.iterations << ',' << r.maxIterations << ',' << r.residual << ','
+              << r.seconds << ',' << report.prepareSeconds << ',' << report.timings.evaluation << ','
+              << report.timings.assembly << ',' << report.timings.factorization << ',' << r.peakKilobytes << ','
+              << r.exponent << '\n';
+}
+
+QJsonObject toJson(const Result& r, Solver::Algorithm algorithm) {
+    QJsonObject json;
+    json["generator"] = QString::fromStdString(r.generator);
+    json["algorithm"] = algorithmName(algorithm);
+    json["parameters"] = static_cast<double>(r.parameters);
+    json["constraints"] = static_cast<double>(r.constraints);
+    json["status"] = Solver::toString(r.status);
+    json["iterations"] = r.iterations;
+    json["maxClusterIterations"] = r.maxIterations;
+    json["residual"] = r.residual;
+    json["seconds"] = r.seconds;
+    json["peakKilobytes"] = static_cast<double>(r.peakKilobytes);
+    json["timeExponent"] = r.exponent;
+
+    // The per-iteration log of a million-parameter solve is not a summary.
+    QJsonObject report = r.report.toJson();
+    report.remove("iterations");
+    report.remove("clusters");
+    json["report"] = report;
+    return json;
+}
+
+bool parseAlgorithm(const std::string& name, Solver::Algorithm& algorithm) {
+    if (name == "gn") algorithm = Solver::Algorithm::GaussNewton;
+    else if (name == "lm") algorithm = Solver::Algorithm::LevenbergMarquardt;
+    else if (name == "dogleg") algorithm = Solver::Algorithm::Dogleg;
+    else return false;
+    return true;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t minParams = 100;
+    size_t maxParams = 1000000;
+    int repeats = 3;
+    unsigned threads = 0;
+    bool json = false;
+    std::string only;
+    Solver::Options options;
+    options.recordIterations = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--min-params" && hasValue) minParams = std::stoul(argv[++i]);
+        else if (arg == "--max-params" && hasValue) maxParams = std::stoul(argv[++i]);
+        else if (arg == "--repeats" && hasValue) repeats = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        else if (arg == "--format" && hasValue) json = std::string(argv[++i]) == "json";
+        else if (arg == "--generator" && hasValue) only = argv[++i];
+        else if (arg == "--algorithm" && hasValue && parseAlgorithm(argv[i + 1], options.algorithm)) ++i;
+        else {
+            std::cerr << "usage: " << argv[0] << " [--min-params N] [--max-params N] [--repeats N]"
+                         " [--algorithm gn|lm|dogleg] [--threads N] [--format csv|json]"
+                         " [--generator chain|grid|frames]\n";
+            return 2;
+        }
+    }
+
+    if (!json) printCsvHeader();
+    QJsonArray records;
+
+    for (const auto& generator : Generators) {
+        if (!only.empty() && only != generator.name) continue;
+
+        Result previous;
+        for (size_t size = minParams; size <= maxParams; size *= 10) {
+            Result result = run(generator, size, options, threads, repeats);
+            if (previous.parameters > 0 && previous.seconds > 0.0 && result.seconds > 0.0) {
+                result.exponent = std::log(result.seconds / previous.seconds) /
+                                  std::log(static_cast<double>(result.parameters) / previous.parameters);
+            }
+
+            if (json) records.append(toJson(result, options.algorithm));
+            else printCsv(result, options.algorithm);
+            std::cout.flush();
+            previous = result;
+        }
+    }
+
+    if (json) std::cout << QJsonDocument(records).toJson().toStdString();
+    return 0;
+}
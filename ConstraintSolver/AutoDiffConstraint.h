@@ -0,0 +1,117 @@
+#ifndef AUTODIFFCONSTRAINT_H
+#define AUTODIFFCONSTRAINT_H
+
+#include "Constraint.h"
+#include "Dual.h"
+#include <utility>
+
+// Base for constraints defined by a single templated residual. Derived
+// classes provide
+//
+//     void collectParameters(const double* (&params)[N]) const;
+//     template<typename T> T residual(const T* x) const;
+//
+// where x holds the N parameter values in collectParameters() order.
+// evaluate() runs the residual on doubles and getGradient() on Dual<N>,
+// so the math is written once and the gradient is exact.
+template<typename Derived, int N>
+class AutoDiffConstraint : public Constraint {
+public:
+    static constexpr int ParameterCount = N;
+    static_assert(N <= GradientRow::Capacity, "too many parameters for a GradientRow");
+
+    double evaluate() const override {
+        const double* params[N];
+        const double* const* bound = m_values;
+        if (!m_values[0]) {
+            derived().collectParameters(params);
+            bound = params;
+        }
+
+        double x[N];
+        for (int i = 0; i < N; ++i) x[i] = *bound[i];
+        return derived().residual(x);
+    }
+
+    void bindParameters(const ParameterIndexMap& indices) override {
+        derived().collectParameters(m_values);
+        for (int i = 0; i < N; ++i) {
+            m_indices[i] = indexOf(indices, m_values[i]);
+            m_values[i] = valueOf(indices, m_values[i]);
+        }
+        dropCancellingColumns();
+    }
+
+    void unbindParameters() override {
+        for (int i = 0; i < N; ++i) {
+            m_values[i] = nullptr;
+            m_indices[i] = -1;
+        }
+    }
+
+    void getGradient(GradientRow& row) const override {
+        Dual<N> r = seededResidual(std::make_integer_sequence<int, N>());
+        for (int i = 0; i < N; ++i) row.add(m_indices[i], r.d[i]);
+    }
+
+protected:
+    AutoDiffConstraint() {
+        for (int i = 0; i < N; ++i) m_indices[i] = -1;
+    }
+
+    // Filled by bindParameters(), in collectParameters() order.
+    const double* m_values[N] = {};
+    int m_indices[N];
+
+private:
+    // Builds the seeded inputs as one initializer so they stay in registers
+    // instead of being stored element by element and reloaded.
+    template<int... I>
+    Dual<N> seededResidual(std::integer_sequence<int, I...>) const {
+        const Dual<N> x[N] = { Dual<N>::variable(*m_values[I], I)... };
+        return derived().residual(x);
+    }
+
+    // Slots the solver merged into one column contribute the sum of their
+    // partials. Where that sum vanishes identically (y1 - y2 once both are
+    // the same y) the residual does not depend on the column at all, and
+    // reporting it would only densify the normal equations. Two unrelated
+    // probe points tell an identical zero from a coincidental one.
+    void dropCancellingColumns() {
+        int first[N];
+        bool shared = false;
+        for (int i = 0; i < N; ++i) {
+            first[i] = i;
+            for (int k = 0; k < i; ++k) {
+                if (m_indices[i] >= 0 && m_indices[k] == m_indices[i]) {
+                    first[i] = first[k];
+                    shared = true;
+                    break;
+                }
+            }
+        }
+        if (!shared) return;
+
+        bool cancels[N];
+        for (int i = 0; i < N; ++i) cancels[i] = true;
+        for (int probe = 1; probe <= 2; ++probe) {
+            Dual<N> x[N];
+            for (int i = 0; i < N; ++i) {
+                x[i] = Dual<N>::variable(*m_values[i] + 0.7548776662 * probe * (first[i] + 1), first[i]);
+            }
+            Dual<N> r = derived().residual(x);
+            for (int i = 0; i < N; ++i) cancels[i] = cancels[i] && r.d[i] == 0.0;
+        }
+
+        for (int i = 0; i < N; ++i) {
+            if (first[i] != i || !cancels[i]) continue;
+            for (int k = i; k < N; ++k) {
+                if (first[k] == i) m_indices[k] = -1;
+            }
+        }
+    }
+
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+#endif
@@ -1,11 +1,11 @@
 #ifndef COINCIDENTCONSTRAINT_H
 #define COINCIDENTCONSTRAINT_H
 
-#include "Constraint.h"
+#include "AutoDiffConstraint.h"
 #include "../GeometryEngine/Point.h"
 #include <memory>
 
-class CoincidentConstraint : public Constraint {
+class CoincidentConstraint : public AutoDiffConstraint<CoincidentConstraint, 4> {
 private:
     std::shared_ptr<Point> m_p1;
     std::shared_ptr<Point> m_p2;
@@ -14,27 +14,39 @@ public:
     CoincidentConstraint(std::shared_ptr<Point> p1, std::shared_ptr<Point> p2)
         : m_p1(p1), m_p2(p2) {}
 
-    double evaluate() const override {
-        double dx = m_p1->x() - m_p2->x();
-        double dy = m_p1->y() - m_p2->y();
+    // x1, y1, x2, y2
+    void collectParameters(const double* (&params)[4]) const {
+        params[0] = m_p1->xParameter();
+        params[1] = m_p1->yParameter();
+        params[2] = m_p2->xParameter();
+        params[3] = m_p2->yParameter();
+    }
+
+    template<typename T>
+    T residual(const T* x) const {
+        T dx = x[0] - x[2];
+        T dy = x[1] - x[3];
         return dx * dx + dy * dy; // Distance squared should be 0
     }
 
-    std::vector<double> getGradient(const std::vector<double*>& allParams) const override {
-        std::vector<double> grad(allParams.size(), 0.0);
-        double dx = 2.0 * (m_p1->x() - m_p2->x());
-        double dy = 2.0 * (m_p1->y() - m_p2->y());
+    int equalities(ParameterEquality* pairs) const override {
+        const double* params[4];
+        collectParameters(params);
+        pairs[0] = { params[0], params[2] };
+        pairs[1] = { params[1], params[3] };
+        return 2;
+    }
 
-        auto p1Params = m_p1->getParameters();
-        auto p2Params = m_p2->getParameters();
+    ConstraintKernel kernel() const override { return ConstraintKernel::Coincident; }
 
-        for (size_t i = 0; i < allParams.size(); ++i) {
-            if (allParams[i] == p1Params[0]) grad[i] = dx;
-            else if (allParams[i] == p1Params[1]) grad[i] = dy;
-            else if (allParams[i] == p2Params[0]) grad[i] = -dx;
-            else if (allParams[i] == p2Params[1]) grad[i] = -dy;
+    KernelTerm kernelTerm() const override {
+        KernelTerm term;
+        for (int i = 0; i < 4; ++i) {
+            term.values[i] = m_values[i];
+            term.indices[i] = m_indices[i];
         }
-        return grad;
+        term.target = 0.0;
+        return term;
     }
 
     std::string getType() const override { return "Coincident"; }
@@ -3,20 +3,105 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <QJsonObject>
 #include <Eigen/Dense>
 
+// Where the solver keeps a parameter: its Jacobian column and the value the
+// constraint should read. The two differ from the parameter itself when the
+// solver has merged it into another through an equality.
+struct ParameterBinding {
+    int index;
+    const double* value;
+};
+
+// Binding of every solver parameter, keyed by its storage.
+using ParameterIndexMap = std::unordered_map<const double*, ParameterBinding>;
+
+// Two parameters a constraint requires to be equal.
+struct ParameterEquality {
+    const double* a;
+    const double* b;
+};
+
+// Non-zero partial derivatives of a single residual. Capacity is fixed so
+// the solver can reuse one row for every constraint and iteration.
+struct GradientRow {
+    static constexpr int Capacity = 8;
+
+    int size = 0;
+    int indices[Capacity];
+    double values[Capacity];
+
+    void clear() { size = 0; }
+
+    // Parameters the solver does not own (index -1) are held fixed.
+    void add(int index, double value) {
+        if (index < 0) return;
+        indices[size] = index;
+        values[size] = value;
+        ++size;
+    }
+};
+
+// Constraint forms the solver evaluates in vectorized batches instead of
+// one virtual evaluate()/getGradient() call at a time.
+enum class ConstraintKernel { None, Coincident, Distance, Horizontal };
+
+// Everything a batch kernel needs about one constraint: where its point
+// coordinates live (x1, y1, x2, y2), their Jacobian columns (-1 if fixed or
+// unused) and the constant it compares against.
+struct KernelTerm {
+    const double* values[4] = { nullptr, nullptr, nullptr, nullptr };
+    int indices[4] = { -1, -1, -1, -1 };
+    double target = 0.0;
+};
+
 class Constraint {
 public:
     virtual ~Constraint() = default;
 
     virtual double evaluate() const = 0;
 
-    virtual std::vector<double> getGradient(const std::vector<double*>& allParams) const = 0;
+    // Resolves the constraint's parameters to Jacobian columns. Called by the
+    // solver once per solve, before any getGradient() call.
+    virtual void bindParameters(const ParameterIndexMap& indices) = 0;
+
+    // Forgets what bindParameters() resolved, so evaluate() reads the
+    // parameters themselves again. Called when the storage the bindings
+    // point into, a sketch's ParameterStore or solver, goes away.
+    virtual void unbindParameters() = 0;
+
+    // Must report every bound parameter, even where its partial is currently
+    // zero: the solver derives the sparsity pattern and clusters from it.
+    virtual void getGradient(GradientRow& row) const = 0;
+
+    // Constraints that only equate parameters list the pairs here, at most
+    // MaxEqualities of them, and return how many. The solver can then merge
+    // the parameters instead of solving a residual for them.
+    static constexpr int MaxEqualities = 2;
+    virtual int equalities(ParameterEquality* /*pairs*/) const { return 0; }
+
+    virtual ConstraintKernel kernel() const { return ConstraintKernel::None; }
+
+    // Only meaningful for kernel() != None, after bindParameters().
+    virtual KernelTerm kernelTerm() const { return {}; }
 
     virtual std::string getType() const = 0;
 
     virtual QJsonObject toJson() const = 0;
+
+protected:
+    static int indexOf(const ParameterIndexMap& indices, const double* param) {
+        auto it = indices.find(param);
+        return it != indices.end() ? it->second.index : -1;
+    }
+
+    // Storage to read a parameter's current value from during a solve.
+    static const double* valueOf(const ParameterIndexMap& indices, const double* param) {
+        auto it = indices.find(param);
+        return it != indices.end() ? it->second.value : param;
+    }
 };
 
 #endif
@@ -0,0 +1,110 @@
+#include "ConstraintBatch.h"
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Terms are gathered in chunks small enough that the coordinate buffers
+// stay in L1 between the gather and the arithmetic.
+constexpr size_t ChunkSize = 256;
+
+// r = |p1 - p2|^2 - target and, if requested, its four partials.
+void pointPairKernel(size_t n, const double* x1, const double* y1, const double* x2, const double* y2,
+                     const double* target, double* r, double* const* partials) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d minusTwo = _mm256_set1_pd(-2.0);
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_load_pd(x1 + i), _mm256_load_pd(x2 + i));
+        __m256d dy = _mm256_sub_pd(_mm256_load_pd(y1 + i), _mm256_load_pd(y2 + i));
+        __m256d sq = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        _mm256_storeu_pd(r + i, _mm256_sub_pd(sq, _mm256_loadu_pd(target + i)));
+        if (partials) {
+            _mm256_storeu_pd(partials[0] + i, _mm256_mul_pd(two, dx));
+            _mm256_storeu_pd(partials[1] + i, _mm256_mul_pd(two, dy));
+            _mm256_storeu_pd(partials[2] + i, _mm256_mul_pd(minusTwo, dx));
+            _mm256_storeu_pd(partials[3] + i, _mm256_mul_pd(minusTwo, dy));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128d two = _mm_set1_pd(2.0);
+    const __m128d minusTwo = _mm_set1_pd(-2.0);
+    for (; i + 2 <= n; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_load_pd(x1 + i), _mm_load_pd(x2 + i));
+        __m128d dy = _mm_sub_pd(_mm_load_pd(y1 + i), _mm_load_pd(y2 + i));
+        __m128d sq = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        _mm_storeu_pd(r + i, _mm_sub_pd(sq, _mm_loadu_pd(target + i)));
+        if (partials) {
+            _mm_storeu_pd(partials[0] + i, _mm_mul_pd(two, dx));
+            _mm_storeu_pd(partials[1] + i, _mm_mul_pd(two, dy));
+            _mm_storeu_pd(partials[2] + i, _mm_mul_pd(minusTwo, dx));
+            _mm_storeu_pd(partials[3] + i, _mm_mul_pd(minusTwo, dy));
+        }
+    }
+#endif
+
+    for (; i < n; ++i) {
+        double dx = x1[i] - x2[i];
+        double dy = y1[i] - y2[i];
+        r[i] = dx * dx + dy * dy - target[i];
+        if (partials) {
+            partials[0][i] = 2.0 * dx;
+            partials[1][i] = 2.0 * dy;
+            partials[2][i] = -2.0 * dx;
+            partials[3][i] = -2.0 * dy;
+        }
+    }
+}
+
+}
+
+void ConstraintBatch::add(const KernelTerm& term) {
+    for (int k = 0; k < 4; ++k) {
+        m_values.push_back(term.values[k]);
+        m_indices.push_back(term.indices[k]);
+    }
+    m_targets.push_back(term.target);
+    for (auto& partials : m_partials) partials.push_back(0.0);
+
+    // Horizontal partials are constant; set them once here.
+    if (m_kernel == ConstraintKernel::Horizontal) {
+        m_partials[1].back() = 1.0;
+        m_partials[3].back() = -1.0;
+    }
+}
+
+void ConstraintBatch::evaluate(double* residuals, bool withPartials) {
+    const size_t n = size();
+    const double* const* v = m_values.data();
+
+    if (m_kernel == ConstraintKernel::Horizontal) {
+        for (size_t i = 0; i < n; ++i, v += 4) {
+            residuals[i] = *v[1] - *v[3];
+        }
+        return;
+    }
+
+    // Coincident and Distance share one kernel.
+    alignas(32) double x1[ChunkSize], y1[ChunkSize], x2[ChunkSize], y2[ChunkSize];
+    for (size_t begin = 0; begin < n; begin += ChunkSize) {
+        const size_t count = std::min(ChunkSize, n - begin);
+        for (size_t i = 0; i < count; ++i, v += 4) {
+            x1[i] = *v[0];
+            y1[i] = *v[1];
+            x2[i] = *v[2];
+            y2[i] = *v[3];
+        }
+
+        double* partials[4] = { m_partials[0].data() + begin, m_partials[1].data() + begin,
+                                m_partials[2].data() + begin, m_partials[3].data() + begin };
+        pointPairKernel(count, x1, y1, x2, y2, m_targets.data() + begin, residuals + begin,
+                        withPartials ? partials : nullptr);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef CONSTRAINTBATCH_H
+#define CONSTRAINTBATCH_H
+
+#include "Constraint.h"
+#include <vector>
+
+// Constraints of a single kernel type stored as structure-of-arrays and
+// evaluated together: point coordinates are gathered in chunks, then
+// residuals and partials are computed with AVX2/SSE2 where available.
+class ConstraintBatch {
+public:
+    explicit ConstraintBatch(ConstraintKernel kernel) : m_kernel(kernel) {}
+
+    ConstraintKernel kernel() const { return m_kernel; }
+    size_t size() const { return m_targets.size(); }
+
+    void add(const KernelTerm& term);
+
+    // Writes one residual per term at the current parameter values, and
+    // refreshes the partials returned by partial() if asked to.
+    void evaluate(double* residuals, bool withPartials = false);
+
+    // Jacobian column and partial of slot k (x1, y1, x2, y2) of term i, in
+    // the same order getGradient() reports them. Valid after
+    // evaluate(..., true).
+    int column(size_t i, int k) const { return m_indices[4 * i + k]; }
+    double partial(size_t i, int k) const { return m_partials[k][i]; }
+
+private:
+    ConstraintKernel m_kernel;
+
+    std::vector<const double*> m_values; // 4 per term
+    std::vector<int> m_indices;          // 4 per term
+    std::vector<double> m_targets;
+
+    std::vector<double> m_partials[4];
+};
+
+#endif
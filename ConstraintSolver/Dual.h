@@ -0,0 +1,87 @@
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <cmath>
+
+// Forward-mode dual number carrying the value and its partials with respect
+// to N independent parameters. Residuals written as templates over the
+// scalar type yield exact gradients when evaluated with Dual<N>.
+template<int N>
+struct Dual {
+    double value = 0.0;
+    double d[N] = {};
+
+    Dual() = default;
+    Dual(double v) : value(v) {}
+
+    // The i-th independent parameter: unit partial in slot i.
+    static Dual variable(double v, int i) {
+        Dual x(v);
+        for (int k = 0; k < N; ++k) x.d[k] = (k == i) ? 1.0 : 0.0;
+        return x;
+    }
+
+    Dual& operator+=(const Dual& b) { return *this = *this + b; }
+    Dual& operator-=(const Dual& b) { return *this = *this - b; }
+    Dual& operator*=(const Dual& b) { return *this = *this * b; }
+    Dual& operator/=(const Dual& b) { return *this = *this / b; }
+
+    friend Dual operator+(const Dual& a, const Dual& b) {
+        Dual r(a.value + b.value);
+        for (int i = 0; i < N; ++i) r.d[i] = a.d[i] + b.d[i];
+        return r;
+    }
+
+    friend Dual operator-(const Dual& a, const Dual& b) {
+        Dual r(a.value - b.value);
+        for (int i = 0; i < N; ++i) r.d[i] = a.d[i] - b.d[i];
+        return r;
+    }
+
+    friend Dual operator-(const Dual& a) {
+        Dual r(-a.value);
+        for (int i = 0; i < N; ++i) r.d[i] = -a.d[i];
+        return r;
+    }
+
+    friend Dual operator*(const Dual& a, const Dual& b) {
+        Dual r(a.value * b.value);
+        for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * b.value + a.value * b.d[i];
+        return r;
+    }
+
+    friend Dual operator/(const Dual& a, const Dual& b) {
+        double inv = 1.0 / b.value;
+        Dual r(a.value * inv);
+        for (int i = 0; i < N; ++i) r.d[i] = (a.d[i] - r.value * b.d[i]) * inv;
+        return r;
+    }
+
+    // Scales every partial by the derivative of an elementary function.
+    friend Dual chain(const Dual& a, double value, double derivative) {
+        Dual r(value);
+        for (int i = 0; i < N; ++i) r.d[i] = derivative * a.d[i];
+        return r;
+    }
+
+    friend Dual sqrt(const Dual& a) {
+        double s = std::sqrt(a.value);
+        return chain(a, s, s > 0.0 ? 0.5 / s : 0.0);
+    }
+
+    friend Dual sin(const Dual& a) { return chain(a, std::sin(a.value), std::cos(a.value)); }
+    friend Dual cos(const Dual& a) { return chain(a, std::cos(a.value), -std::sin(a.value)); }
+
+    friend Dual abs(const Dual& a) { return a.value < 0.0 ? -a : a; }
+
+    friend Dual atan2(const Dual& y, const Dual& x) {
+        double denom = x.value * x.value + y.value * y.value;
+        Dual r(std::atan2(y.value, x.value));
+        if (denom > 0.0) {
+            for (int i = 0; i < N; ++i) r.d[i] = (x.value * y.d[i] - y.value * x.d[i]) / denom;
+        }
+        return r;
+    }
+};
+
+#endif
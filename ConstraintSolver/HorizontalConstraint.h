@@ -1,11 +1,11 @@
 #ifndef HORIZONTALCONSTRAINT_H
 #define HORIZONTALCONSTRAINT_H
 
-#include "Constraint.h"
+#include "AutoDiffConstraint.h"
 #include "../GeometryEngine/Point.h"
 #include <memory>
 
-class HorizontalConstraint : public Constraint {
+class HorizontalConstraint : public AutoDiffConstraint<HorizontalConstraint, 2> {
 private:
     std::shared_ptr<Point> m_p1;
     std::shared_ptr<Point> m_p2;
@@ -14,21 +14,33 @@ public:
     HorizontalConstraint(std::shared_ptr<Point> p1, std::shared_ptr<Point> p2)
         : m_p1(p1), m_p2(p2) {}
 
-    double evaluate() const override {
-        return m_p1->y() - m_p2->y(); // Y coordinates should be equal
+    // y1, y2
+    void collectParameters(const double* (&params)[2]) const {
+        params[0] = m_p1->yParameter();
+        params[1] = m_p2->yParameter();
     }
 
-    std::vector<double> getGradient(const std::vector<double*>& allParams) const override {
-        std::vector<double> grad(allParams.size(), 0.0);
-        
-        auto p1Params = m_p1->getParameters();
-        auto p2Params = m_p2->getParameters();
-
-        for (size_t i = 0; i < allParams.size(); ++i) {
-            if (allParams[i] == p1Params[1]) grad[i] = 1.0;
-            else if (allParams[i] == p2Params[1]) grad[i] = -1.0;
-        }
-        return grad;
+    template<typename T>
+    T residual(const T* x) const {
+        return x[0] - x[1]; // Y coordinates should be equal
+    }
+
+    int equalities(ParameterEquality* pairs) const override {
+        const double* params[2];
+        collectParameters(params);
+        pairs[0] = { params[0], params[1] };
+        return 1;
+    }
+
+    ConstraintKernel kernel() const override { return ConstraintKernel::Horizontal; }
+
+    KernelTerm kernelTerm() const override {
+        KernelTerm term;
+        term.values[1] = m_values[0];
+        term.values[3] = m_values[1];
+        term.indices[1] = m_indices[0];
+        term.indices[3] = m_indices[1];
+        return term;
     }
 
     std::string getType() const override { return "Horizontal"; }
@@ -1,39 +1,1024 @@
 #include "Solver.h"
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Adds the lifetime of the scope to a running total.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(double& total) : m_total(total), m_start(Clock::now()) {}
+    ~ScopedTimer() { m_total += secondsSince(m_start); }
+
+private:
+    double& m_total;
+    Clock::time_point m_start;
+};
+
+int findRoot(std::vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+Eigen::VectorXd failedStep(Eigen::Index size) {
+    return Eigen::VectorXd::Constant(size, std::numeric_limits<double>::quiet_NaN());
+}
+
+// Maps a step in scaled units back to parameter units. Columns that never
+// had a gradient were left unscaled.
+Eigen::VectorXd unscaleStep(const Eigen::VectorXd& h, const Eigen::VectorXd& scale) {
+    Eigen::VectorXd delta(h.size());
+    for (Eigen::Index j = 0; j < h.size(); ++j) {
+        delta(j) = scale(j) > 0.0 ? h(j) / scale(j) : h(j);
+    }
+    return delta;
+}
+
+}
+
+void Solver::clear() {
+    m_constraints.clear();
+    m_parameters.clear();
+    m_clusters.clear();
+    m_caches.clear();
+    m_freeAliases.clear();
+    m_pendingWrites.clear();
+    m_writtenOutsideClusters.clear();
+    m_report = Report();
+    m_prepared = false;
+}
 
 Solver::Status Solver::solve() {
-    if (m_constraints.empty()) return Status::Solved;
-    if (m_parameters.empty()) return Status::UnderConstrained;
+    m_report = Report();
+    m_writtenOutsideClusters.clear();
+    if (m_constraints.empty()) return m_report.status = Status::Solved;
+    if (m_parameters.empty()) return m_report.status = Status::UnderConstrained;
+
+    const auto start = Clock::now();
+    if (!m_prepared) prepare();
+    m_report.prepareSeconds = secondsSince(start);
+
+    std::vector<int> all(m_clusters.size());
+    std::iota(all.begin(), all.end(), 0);
+    solveAndReport(all);
+    return m_report.status;
+}
+
+void Solver::markModified(const double* param) {
+    if (!m_prepared) prepare();
+
+    auto it = m_indices.find(param);
+    if (it == m_indices.end()) return;
+
+    // Edits to a merged parameter move the whole group.
+    const int j = it->second.index;
+    if (m_parameters[j] != param) *m_parameters[j] = *param;
+
+    m_modified[j] = 1;
+    int cluster = m_clusterOf[j];
+    if (cluster < 0) {
+        m_freeAliasesDirty = true;
+        if (m_parameters[j] != param) m_pendingWrites.push_back(j);
+    }
+    if (cluster >= 0 && std::find(m_dirtyClusters.begin(), m_dirtyClusters.end(), cluster) == m_dirtyClusters.end()) {
+        m_dirtyClusters.push_back(cluster);
+    }
+}
+
+Solver::Status Solver::resolve() {
+    if (!m_prepared) return solve();
+
+    m_report = Report();
+    m_writtenOutsideClusters.clear();
+    m_report.incremental = true;
+    const std::vector<int> dirty(m_dirtyClusters);
+    solveAndReport(dirty);
+    return m_report.status;
+}
+
+void Solver::solveAndReport(const std::vector<int>& which) {
+    const auto start = Clock::now();
+    solveClusters(which);
+
+    Report& report = m_report;
+    report.status = aggregateStatus();
+    report.parameters = m_parameters.size();
+    report.constraints = m_constraints.size();
+    report.eliminatedParameters = m_eliminatedParameters;
+    report.eliminatedConstraints = m_eliminatedConstraints;
+    report.clusterCount = m_clusters.size();
+
+    for (int c : which) {
+        const auto& cluster = m_clusters[c];
+        auto& cache = m_caches[c];
+
+        ClusterReport entry;
+        entry.cluster = c;
+        entry.rows = cluster.constraints.size();
+        entry.columns = cluster.parameters.size();
+        entry.sparse = cache.sparse;
+        entry.nonZeros = cache.sparse ? static_cast<size_t>(cache.jacobian.nonZeros()) : entry.rows * entry.columns;
+        entry.status = cluster.status;
+        entry.termination = cluster.termination;
+        entry.iterations = cluster.iterations;
+        entry.freedom = cluster.freedom;
+        entry.redundant = cluster.redundant.size();
+        entry.conflicting = cluster.conflicting.size();
+        entry.timings = cache.timings;
+        report.clusters.push_back(entry);
+
+        report.nonZeros += entry.nonZeros;
+        report.timings.evaluation += cache.timings.evaluation;
+        report.timings.assembly += cache.timings.assembly;
+        report.timings.factorization += cache.timings.factorization;
+        for (Iteration iteration : cache.log) {
+            iteration.cluster = c;
+            report.iterations.push_back(iteration);
+        }
+    }
+
+    report.totalSeconds = report.prepareSeconds + secondsSince(start);
+}
+
+Solver::Status Solver::aggregateStatus() const {
+    bool under = false;
+    bool over = false;
+    size_t constrainedParameters = 0;
+    for (size_t c = 0; c < m_clusters.size(); ++c) {
+        const auto& cluster = m_clusters[c];
+        if (cluster.status == Status::Failed) return Status::Failed;
+        under |= cluster.status == Status::UnderConstrained;
+        over |= cluster.status == Status::OverConstrained;
+        constrainedParameters += cluster.parameters.size() + m_caches[c].aliases.size();
+    }
+
+    if (over) return Status::OverConstrained;
+    if (under || constrainedParameters < m_parameters.size()) return Status::UnderConstrained;
+    return Status::Solved;
+}
+
+void Solver::prepare() {
+    bindParameters();
+    buildClusters();
+
+    m_caches = std::vector<ClusterCache>(m_clusters.size());
+    for (size_t c = 0; c < m_clusters.size(); ++c) {
+        auto& cluster = m_clusters[c];
+        auto& cache = m_caches[c];
+        if (m_options.batchKernels) buildBatches(cluster, cache);
+        cache.sparse = cluster.parameters.size() >= m_sparseThreshold;
+        if (cache.sparse) {
+            buildSparsePattern(cluster, cache);
+        } else {
+            cache.dense.resize(cluster.constraints.size(), cluster.parameters.size());
+        }
+    }
+
+    m_freeAliases.clear();
+    for (size_t j = 0; j < m_parameters.size(); ++j) {
+        const int representative = m_representative[j];
+        if (representative == static_cast<int>(j)) continue;
+        const int cluster = m_clusterOf[representative];
+        (cluster >= 0 ? m_caches[cluster].aliases : m_freeAliases).push_back(static_cast<int>(j));
+    }
+    m_freeAliasesDirty = true;
+
+    m_modified.assign(m_parameters.size(), 0);
+    m_dirtyClusters.clear();
+    m_prepared = true;
+}
+
+void Solver::bindParameters() {
+    m_indices.clear();
+    m_indices.reserve(m_parameters.size());
+    for (size_t j = 0; j < m_parameters.size(); ++j) {
+        m_indices.emplace(m_parameters[j], ParameterBinding{ static_cast<int>(j), m_parameters[j] });
+    }
+    eliminateEqualities();
+    for (auto& constraint : m_constraints) {
+        constraint->bindParameters(m_indices);
+    }
+}
+
+void Solver::eliminateEqualities() {
+    const int parameterCount = static_cast<int>(m_parameters.size());
+    m_representative.resize(parameterCount);
+    std::iota(m_representative.begin(), m_representative.end(), 0);
+    m_eliminated.assign(m_constraints.size(), 0);
+    m_eliminatedParameters = 0;
+    m_eliminatedConstraints = 0;
+    if (!m_options.eliminateEqualities) return;
+
+    // Union the equated parameters, keeping the lowest index as the root so
+    // the first-added entity of a group keeps its position. A constraint is
+    // only dropped if all its parameters are the solver's to move; an
+    // equality with a fixed value stays a residual.
+    auto& parent = m_representative;
+    ParameterEquality pairs[Constraint::MaxEqualities];
+    for (size_t i = 0; i < m_constraints.size(); ++i) {
+        const int count = m_constraints[i]->equalities(pairs);
+        if (count == 0) continue;
+
+        int a[Constraint::MaxEqualities], b[Constraint::MaxEqualities];
+        bool free = true;
+        for (int k = 0; k < count && free; ++k) {
+            auto itA = m_indices.find(pairs[k].a);
+            auto itB = m_indices.find(pairs[k].b);
+            free = itA != m_indices.end() && itB != m_indices.end();
+            if (free) {
+                a[k] = itA->second.index;
+                b[k] = itB->second.index;
+            }
+        }
+        if (!free) continue;
+
+        for (int k = 0; k < count; ++k) {
+            int rootA = findRoot(parent, a[k]);
+            int rootB = findRoot(parent, b[k]);
+            if (rootA != rootB) parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+        }
+        m_eliminated[i] = 1;
+        ++m_eliminatedConstraints;
+    }
+
+    // Merged parameters read and report through their representative.
+    for (int j = 0; j < parameterCount; ++j) {
+        const int representative = findRoot(parent, j);
+        parent[j] = representative;
+        if (representative == j) continue;
+        m_indices[m_parameters[j]] = ParameterBinding{ representative, m_parameters[representative] };
+        ++m_eliminatedParameters;
+    }
+}
 
-    const int maxIterations = 50;
-    const double epsilon = 1e-6;
+void Solver::copyAliases(const std::vector<int>& aliases) const {
+    for (int j : aliases) {
+        *m_parameters[j] = *m_parameters[m_representative[j]];
+    }
+}
+
+void Solver::buildClusters() {
+    const int parameterCount = static_cast<int>(m_parameters.size());
+
+    // Union every parameter a constraint touches; each resulting set is an
+    // independent subsystem.
+    std::vector<int> parent(parameterCount);
+    std::iota(parent.begin(), parent.end(), 0);
+
+    std::vector<int> firstParameter(m_constraints.size(), -1);
+    GradientRow row;
+    for (size_t i = 0; i < m_constraints.size(); ++i) {
+        if (m_eliminated[i]) continue;
+        row.clear();
+        m_constraints[i]->getGradient(row);
+        if (row.size == 0) continue;
+        firstParameter[i] = row.indices[0];
+        int root = findRoot(parent, row.indices[0]);
+        for (int k = 1; k < row.size; ++k) {
+            int other = findRoot(parent, row.indices[k]);
+            if (other != root) parent[other] = root;
+        }
+    }
+
+    m_clusters.clear();
+    std::vector<int> clusterOfRoot(parameterCount, -1);
+    for (size_t i = 0; i < m_constraints.size(); ++i) {
+        if (m_eliminated[i]) continue;
+        if (firstParameter[i] < 0) {
+            // Only touches fixed parameters: nothing to solve, but the
+            // residual still decides whether the sketch is consistent.
+            m_clusters.emplace_back();
+            m_clusters.back().constraints.push_back(static_cast<int>(i));
+            continue;
+        }
+        int root = findRoot(parent, firstParameter[i]);
+        if (clusterOfRoot[root] < 0) {
+            clusterOfRoot[root] = static_cast<int>(m_clusters.size());
+            m_clusters.emplace_back();
+        }
+        m_clusters[clusterOfRoot[root]].constraints.push_back(static_cast<int>(i));
+    }
 
-    for (int iter = 0; iter < maxIterations; ++iter) {
-        Eigen::VectorXd r(m_constraints.size());
-        for (size_t i = 0; i < m_constraints.size(); ++i) {
-            r(i) = m_constraints[i]->evaluate();
+    m_clusterOf.assign(parameterCount, -1);
+    m_localIndex.assign(parameterCount, -1);
+    for (int j = 0; j < parameterCount; ++j) {
+        if (m_representative[j] != j) continue; // merged; solved through its representative
+        int cluster = clusterOfRoot[findRoot(parent, j)];
+        if (cluster < 0) continue; // unconstrained
+        m_clusterOf[j] = cluster;
+        m_clusters[cluster].parameters.push_back(j);
+    }
+
+    // Order columns by address: parameters packed in a sketch's
+    // ParameterStore are then gathered and scattered in a linear sweep.
+    for (auto& cluster : m_clusters) {
+        auto& params = cluster.parameters;
+        std::sort(params.begin(), params.end(), [this](int a, int b) {
+            return std::less<const double*>()(m_parameters[a], m_parameters[b]);
+        });
+        for (size_t k = 0; k < params.size(); ++k) {
+            m_localIndex[params[k]] = static_cast<int>(k);
         }
+    }
+}
+
+void Solver::buildBatches(Cluster& cluster, ClusterCache& cache) const {
+    // Rows are grouped by kernel so each batch covers a contiguous range;
+    // constraints without a kernel keep their relative order at the end.
+    auto rank = [this](int i) {
+        ConstraintKernel kernel = m_constraints[i]->kernel();
+        return kernel == ConstraintKernel::None ? std::numeric_limits<int>::max() : static_cast<int>(kernel);
+    };
+    std::stable_sort(cluster.constraints.begin(), cluster.constraints.end(),
+                     [&rank](int a, int b) { return rank(a) < rank(b); });
 
-        if (r.norm() < epsilon) {
-            if (m_constraints.size() < m_parameters.size()) return Status::UnderConstrained;
-            if (m_constraints.size() > m_parameters.size()) return Status::OverConstrained;
-            return Status::Solved;
+    cache.batches.clear();
+    cache.batchedRows = 0;
+    for (int i : cluster.constraints) {
+        ConstraintKernel kernel = m_constraints[i]->kernel();
+        if (kernel == ConstraintKernel::None) break;
+        if (cache.batches.empty() || cache.batches.back().kernel() != kernel) {
+            cache.batches.emplace_back(kernel);
         }
+        cache.batches.back().add(m_constraints[i]->kernelTerm());
+        ++cache.batchedRows;
+    }
+    cache.batchResiduals.resize(cache.batchedRows);
+}
+
+void Solver::buildSparsePattern(const Cluster& cluster, ClusterCache& cache) const {
+    const Eigen::Index rows = static_cast<Eigen::Index>(cluster.constraints.size());
+    const Eigen::Index cols = static_cast<Eigen::Index>(cluster.parameters.size());
+
+    std::vector<Eigen::Triplet<double>> triplets;
+    GradientRow row;
+    for (Eigen::Index i = 0; i < rows; ++i) {
+        row.clear();
+        m_constraints[cluster.constraints[i]]->getGradient(row);
+        for (int k = 0; k < row.size; ++k) {
+            triplets.emplace_back(static_cast<int>(i), m_localIndex[row.indices[k]], 0.0);
+        }
+    }
+
+    cache.jacobian.resize(rows, cols);
+    cache.jacobian.setFromTriplets(triplets.begin(), triplets.end());
+    cache.jacobian.makeCompressed();
+
+    // Remember where each entry lands so later assemblies write values
+    // straight into the compressed storage.
+    const int* outer = cache.jacobian.outerIndexPtr();
+    const int* inner = cache.jacobian.innerIndexPtr();
+    cache.entryOffsets.resize(triplets.size());
+    for (size_t e = 0; e < triplets.size(); ++e) {
+        const int col = triplets[e].col();
+        const int* pos = std::lower_bound(inner + outer[col], inner + outer[col + 1], triplets[e].row());
+        cache.entryOffsets[e] = static_cast<int>(pos - inner);
+    }
+    cache.analyzed = false;
+}
+
+void Solver::solveClusters(const std::vector<int>& which) {
+    unsigned threads = m_threadCount ? m_threadCount : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, which.size()));
+
+    size_t workload = 0;
+    for (int c : which) workload += m_clusters[c].parameters.size();
+
+    auto solveOne = [this](int c) {
+        m_caches[c].timings = Timings();
+        m_caches[c].log.clear();
+        solveCluster(m_clusters[c], m_caches[c], true);
+        // A held value the constraints cannot accept must not fail the
+        // whole cluster; let the solver move it as well.
+        if (m_clusters[c].status == Status::Failed) {
+            solveCluster(m_clusters[c], m_caches[c], false);
+        }
+        copyAliases(m_caches[c].aliases);
+    };
+
+    if (threads <= 1 || workload < ParallelThreshold) {
+        for (int c : which) solveOne(c);
+    } else {
+        // Hand out the largest clusters first so one big profile does not
+        // end up queued behind hundreds of bolt holes.
+        std::vector<int> order(which);
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return m_clusters[a].parameters.size() > m_clusters[b].parameters.size();
+        });
 
-        Eigen::MatrixXd J(m_constraints.size(), m_parameters.size());
-        for (size_t i = 0; i < m_constraints.size(); ++i) {
-            std::vector<double> grad = m_constraints[i]->getGradient(m_parameters);
-            for (size_t j = 0; j < m_parameters.size(); ++j) {
-                J(i, j) = grad[j];
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t i = next++; i < order.size(); i = next++) {
+                solveOne(order[i]);
             }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(threads - 1);
+        for (unsigned t = 1; t < threads; ++t) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool) {
+            thread.join();
         }
+    }
+
+    m_writtenOutsideClusters.swap(m_pendingWrites);
+    m_pendingWrites.clear();
+    if (m_freeAliasesDirty) {
+        copyAliases(m_freeAliases);
+        m_freeAliasesDirty = false;
+        m_writtenOutsideClusters.insert(m_writtenOutsideClusters.end(), m_freeAliases.begin(), m_freeAliases.end());
+    }
+
+    for (int c : which) {
+        for (int j : m_clusters[c].parameters) m_modified[j] = 0;
+    }
+    m_dirtyClusters.clear();
+}
+
+void Solver::solveCluster(Cluster& cluster, ClusterCache& cache, bool holdModified) const {
+    const size_t rows = cluster.constraints.size();
+    const size_t cols = cluster.parameters.size();
+
+    Termination termination = Termination::NotRun;
+    switch (m_options.algorithm) {
+        case Algorithm::GaussNewton:        termination = solveGaussNewton(cluster, cache, holdModified); break;
+        case Algorithm::LevenbergMarquardt: termination = solveLevenbergMarquardt(cluster, cache, holdModified); break;
+        case Algorithm::Dogleg:             termination = solveDogleg(cluster, cache, holdModified); break;
+    }
+    cluster.termination = termination;
+
+    if (m_options.analyzeRank) {
+        analyzeCluster(cluster, cache);
+        rankStatus(cluster);
+        return;
+    }
+
+    // An earlier analysis no longer holds at the new values.
+    cluster.redundant.clear();
+    cluster.conflicting.clear();
+    cluster.rank = -1;
+    cluster.freedom = -1;
+    cache.nullSpaceKnown = false;
+    cache.rankKnown = false;
 
-        Eigen::VectorXd delta = J.completeOrthogonalDecomposition().solve(-r);
+    // Without the analysis, counts are all there is; redundant constraints
+    // make this guess wrong.
+    if (termination != Termination::Converged) cluster.status = Status::Failed;
+    else if (rows < cols) cluster.status = Status::UnderConstrained;
+    else if (rows > cols) cluster.status = Status::OverConstrained;
+    else cluster.status = Status::Solved;
+}
 
-        for (size_t j = 0; j < m_parameters.size(); ++j) {
-            *m_parameters[j] += delta(j);
+void Solver::rankStatus(Cluster& cluster) const {
+    if (cluster.termination != Termination::Converged) cluster.status = Status::Failed;
+    else if (!cluster.redundant.empty()) cluster.status = Status::OverConstrained;
+    else if (cluster.freedom > 0) cluster.status = Status::UnderConstrained;
+    else cluster.status = Status::Solved;
+}
+
+Solver::Status Solver::analyze() {
+    if (!m_prepared) return m_report.status;
+    for (size_t c = 0; c < m_clusters.size(); ++c) {
+        Cluster& cluster = m_clusters[c];
+        ClusterCache& cache = m_caches[c];
+        if (cache.rankKnown || cluster.termination == Termination::NotRun) continue;
+        analyzeCluster(cluster, cache);
+        rankStatus(cluster);
+    }
+    for (auto& entry : m_report.clusters) {
+        const Cluster& cluster = m_clusters[entry.cluster];
+        entry.status = cluster.status;
+        entry.freedom = cluster.freedom;
+        entry.redundant = cluster.redundant.size();
+        entry.conflicting = cluster.conflicting.size();
+    }
+    return m_report.status = aggregateStatus();
+}
+
+void Solver::analyzeCluster(Cluster& cluster, ClusterCache& cache) const {
+    const Eigen::Index rows = static_cast<Eigen::Index>(cluster.constraints.size());
+    const Eigen::Index cols = static_cast<Eigen::Index>(cluster.parameters.size());
+
+    cluster.redundant.clear();
+    cluster.conflicting.clear();
+    cluster.rank = -1;
+    cluster.freedom = -1;
+    cache.nullSpace.resize(0, 0);
+    cache.nullSpaceKnown = false;
+    cache.rankKnown = true;
+
+    Eigen::VectorXd r(rows);
+    evaluateResiduals(cluster, cache, r);
+
+    // Constraints on fixed parameters only: nothing to factor.
+    if (cols == 0) {
+        for (Eigen::Index i = 0; i < rows; ++i) {
+            if (std::abs(r(i)) >= m_options.residualTolerance) cluster.conflicting.push_back(cluster.constraints[i]);
         }
+        cluster.rank = 0;
+        cluster.freedom = 0;
+        cache.nullSpaceKnown = true;
+        return;
+    }
+
+    // Factor J^T: its pivot columns are a maximal independent set of
+    // constraints, and the trailing columns of Q span the null space of J,
+    // i.e. the motions no constraint resists.
+    assembleJacobian(cluster, cache, false);
+    ScopedTimer timer(cache.timings.factorization);
+
+    std::vector<char> independent(rows, 0);
+    Eigen::VectorXd rowNorms = Eigen::VectorXd::Zero(rows);
+    Eigen::Index rank = 0;
+
+    if (cache.sparse) {
+        Eigen::SparseMatrix<double> transposed = cache.jacobian.transpose();
+        transposed.makeCompressed();
+        for (Eigen::Index i = 0; i < rows; ++i) rowNorms(i) = transposed.col(i).norm();
+
+        Eigen::SparseQR<Eigen::SparseMatrix<double>, Eigen::COLAMDOrdering<int>> qr;
+        qr.setPivotThreshold(m_options.rankTolerance * std::max(rowNorms.maxCoeff(), 1.0));
+        qr.compute(transposed);
+        if (qr.info() != Eigen::Success) return;
+
+        rank = qr.rank();
+        for (Eigen::Index k = 0; k < rank; ++k) independent[qr.colsPermutation().indices()(k)] = 1;
+
+        const Eigen::Index freedom = cols - rank;
+        if (static_cast<size_t>(cols) * static_cast<size_t>(freedom) <= NullSpaceBudget) {
+            Eigen::MatrixXd tail = Eigen::MatrixXd::Zero(cols, freedom);
+            tail.bottomRows(freedom).setIdentity();
+            cache.nullSpace = qr.matrixQ() * tail;
+            cache.nullSpaceKnown = true;
+        }
+    } else {
+        Eigen::MatrixXd transposed = cache.dense.transpose();
+        rowNorms = transposed.colwise().norm().transpose();
+
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(transposed.rows(), transposed.cols());
+        qr.setThreshold(m_options.rankTolerance);
+        qr.compute(transposed);
+
+        rank = qr.rank();
+        for (Eigen::Index k = 0; k < rank; ++k) independent[qr.colsPermutation().indices()(k)] = 1;
+
+        Eigen::MatrixXd q = qr.householderQ();
+        cache.nullSpace = q.rightCols(cols - rank);
+        cache.nullSpaceKnown = true;
+    }
+
+    // A satisfied constraint whose gradient vanishes (coincident points
+    // under a squared-distance residual) carries no rank information and is
+    // not flagged.
+    for (Eigen::Index i = 0; i < rows; ++i) {
+        if (independent[i]) continue;
+        const bool satisfied = std::abs(r(i)) < m_options.residualTolerance;
+        if (satisfied && rowNorms(i) == 0.0) continue;
+        (satisfied ? cluster.redundant : cluster.conflicting).push_back(cluster.constraints[i]);
+    }
+
+    cluster.rank = static_cast<int>(rank);
+    cluster.freedom = static_cast<int>(cols - rank);
+}
+
+int Solver::freedom(const std::vector<double*>& params) const {
+    if (!m_prepared) return -1;
+
+    // Merged parameters count once, through their representative.
+    std::vector<int> columns;
+    for (const double* param : params) {
+        auto it = m_indices.find(param);
+        if (it == m_indices.end()) continue; // fixed
+        if (std::find(columns.begin(), columns.end(), it->second.index) == columns.end()) {
+            columns.push_back(it->second.index);
+        }
+    }
+
+    // Clusters are independent, so their contributions add up.
+    int result = 0;
+    std::vector<char> done(columns.size(), 0);
+    for (size_t a = 0; a < columns.size(); ++a) {
+        if (done[a]) continue;
+        const int cluster = m_clusterOf[columns[a]];
+        if (cluster < 0) {
+            ++result; // unconstrained
+            continue;
+        }
+
+        const auto& cache = m_caches[cluster];
+        if (!cache.nullSpaceKnown) return -1;
+
+        std::vector<int> local;
+        for (size_t b = a; b < columns.size(); ++b) {
+            if (m_clusterOf[columns[b]] != cluster) continue;
+            local.push_back(m_localIndex[columns[b]]);
+            done[b] = 1;
+        }
+        if (cache.nullSpace.cols() == 0) continue;
+
+        Eigen::MatrixXd rowsOfBasis(local.size(), cache.nullSpace.cols());
+        for (size_t k = 0; k < local.size(); ++k) rowsOfBasis.row(k) = cache.nullSpace.row(local[k]);
+        Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(rowsOfBasis.rows(), rowsOfBasis.cols());
+        qr.setThreshold(std::sqrt(m_options.rankTolerance));
+        qr.compute(rowsOfBasis);
+        result += static_cast<int>(qr.rank());
+    }
+    return result;
+}
+
+std::vector<int> Solver::redundantConstraints() const {
+    std::vector<int> result;
+    for (const auto& cluster : m_clusters) {
+        result.insert(result.end(), cluster.redundant.begin(), cluster.redundant.end());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<int> Solver::conflictingConstraints() const {
+    std::vector<int> result;
+    for (const auto& cluster : m_clusters) {
+        result.insert(result.end(), cluster.conflicting.begin(), cluster.conflicting.end());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+Solver::Termination Solver::solveGaussNewton(Cluster& cluster, ClusterCache& cache, bool holdModified) const {
+    const size_t cols = cluster.parameters.size();
+
+    Eigen::VectorXd r(cluster.constraints.size());
+    for (cluster.iterations = 0; cluster.iterations < m_options.maxIterations; ++cluster.iterations) {
+        evaluateResiduals(cluster, cache, r);
+        const double residualNorm = r.norm();
+        if (residualNorm < m_options.residualTolerance) return Termination::Converged;
+        if (cols == 0) return Termination::NoFreeParameters;
+
+        assembleJacobian(cluster, cache, holdModified);
+        Eigen::VectorXd delta = solveStep(cache, r, 0.0);
+        if (!delta.allFinite()) return Termination::SingularStep;
+
+        for (size_t j = 0; j < cols; ++j) {
+            *m_parameters[cluster.parameters[j]] += delta(j);
+        }
+        record(cache, cluster.iterations, residualNorm, delta.norm(), 0.0, true);
+    }
+
+    evaluateResiduals(cluster, cache, r);
+    return r.norm() < m_options.residualTolerance ? Termination::Converged : Termination::MaxIterations;
+}
+
+Solver::Termination Solver::solveLevenbergMarquardt(Cluster& cluster, ClusterCache& cache, bool holdModified) const {
+    const Eigen::Index cols = static_cast<Eigen::Index>(cluster.parameters.size());
+
+    Eigen::VectorXd r(cluster.constraints.size());
+    Eigen::VectorXd trialR(r.size());
+    Eigen::VectorXd x(cols);
+    Eigen::VectorXd scale = Eigen::VectorXd::Zero(cols);
+    Eigen::VectorXd g;
+
+    evaluateResiduals(cluster, cache, r);
+    double cost = 0.5 * r.squaredNorm();
+    double damping = -1.0;
+    double growth = 2.0;
+    bool jacobianCurrent = false;
+
+    for (cluster.iterations = 0; cluster.iterations < m_options.maxIterations; ++cluster.iterations) {
+        const double residualNorm = r.norm();
+        if (residualNorm < m_options.residualTolerance) return Termination::Converged;
+        if (cols == 0) return Termination::NoFreeParameters;
+
+        // The Jacobian only changes after an accepted step; a rejected step
+        // is retried from the same linearization with more damping.
+        if (!jacobianCurrent) {
+            assembleJacobian(cluster, cache, holdModified);
+            if (m_options.scaleParameters) scaleJacobian(cache, scale);
+            g = multiplyTransposed(cache, r);
+            if (g.lpNorm<Eigen::Infinity>() < m_options.gradientTolerance) return Termination::Stationary;
+            jacobianCurrent = true;
+
+            if (damping < 0.0) {
+                damping = m_options.initialDamping * std::max(maxColumnSquaredNorm(cache), 1e-12);
+            }
+        }
+
+        Eigen::VectorXd h = solveStep(cache, r, damping);
+        if (!h.allFinite()) return Termination::SingularStep;
+
+        readParameters(cluster, x);
+        Eigen::VectorXd delta = m_options.scaleParameters ? unscaleStep(h, scale) : h;
+        const double stepNorm = delta.norm();
+        if (stepNorm <= m_options.stepTolerance * (x.norm() + m_options.stepTolerance)) return Termination::StepTooSmall;
+
+        writeParameters(cluster, x + delta);
+        evaluateResiduals(cluster, cache, trialR);
+        double trialCost = 0.5 * trialR.squaredNorm();
+
+        // Gain ratio against the linear model: L(0) - L(h) = h^T (mu h - g) / 2.
+        double predicted = 0.5 * h.dot(damping * h - g);
+        double rho = predicted > 0.0 ? (cost - trialCost) / predicted : -1.0;
+        const bool accepted = rho > 0.0 && std::isfinite(trialCost);
+        record(cache, cluster.iterations, residualNorm, stepNorm, damping, accepted);
+
+        if (accepted) {
+            r.swap(trialR);
+            cost = trialCost;
+            damping *= std::max(1.0 / 3.0, 1.0 - std::pow(2.0 * rho - 1.0, 3));
+            growth = 2.0;
+            jacobianCurrent = false;
+        } else {
+            writeParameters(cluster, x);
+            damping *= growth;
+            growth *= 2.0;
+        }
+    }
+
+    return r.norm() < m_options.residualTolerance ? Termination::Converged : Termination::MaxIterations;
+}
+
+Solver::Termination Solver::solveDogleg(Cluster& cluster, ClusterCache& cache, bool holdModified) const {
+    const Eigen::Index cols = static_cast<Eigen::Index>(cluster.parameters.size());
+
+    Eigen::VectorXd r(cluster.constraints.size());
+    Eigen::VectorXd trialR(r.size());
+    Eigen::VectorXd x(cols);
+    Eigen::VectorXd scale = Eigen::VectorXd::Zero(cols);
+    Eigen::VectorXd g, gaussNewton, steepest;
+    double steepestLength = 0.0;
+
+    evaluateResiduals(cluster, cache, r);
+    double cost = 0.5 * r.squaredNorm();
+    double radius = m_options.initialTrustRadius;
+    bool jacobianCurrent = false;
+
+    for (cluster.iterations = 0; cluster.iterations < m_options.maxIterations; ++cluster.iterations) {
+        const double residualNorm = r.norm();
+        if (residualNorm < m_options.residualTolerance) return Termination::Converged;
+        if (cols == 0) return Termination::NoFreeParameters;
+
+        if (!jacobianCurrent) {
+            assembleJacobian(cluster, cache, holdModified);
+            if (m_options.scaleParameters) scaleJacobian(cache, scale);
+            g = multiplyTransposed(cache, r);
+            if (g.lpNorm<Eigen::Infinity>() < m_options.gradientTolerance) return Termination::Stationary;
+
+            gaussNewton = solveStep(cache, r, 0.0);
+            if (!gaussNewton.allFinite()) return Termination::SingularStep;
+
+            // Cauchy point: minimizer of the model along -g.
+            double curvature = multiply(cache, g).squaredNorm();
+            steepest = -(g.squaredNorm() / std::max(curvature, 1e-300)) * g;
+            steepestLength = steepest.norm();
+            jacobianCurrent = true;
+        }
+
+        Eigen::VectorXd h;
+        if (gaussNewton.norm() <= radius) {
+            h = gaussNewton;
+        } else if (steepestLength >= radius) {
+            h = (radius / steepestLength) * steepest;
+        } else {
+            // Walk from the Cauchy point towards the Gauss-Newton point until
+            // the trust-region boundary: ||a + beta (b - a)|| = radius.
+            Eigen::VectorXd d = gaussNewton - steepest;
+            double a = d.squaredNorm();
+            double b = 2.0 * steepest.dot(d);
+            double c = steepest.squaredNorm() - radius * radius;
+            double beta = (-b + std::sqrt(std::max(b * b - 4.0 * a * c, 0.0))) / (2.0 * a);
+            h = steepest + beta * d;
+        }
+
+        readParameters(cluster, x);
+        Eigen::VectorXd delta = m_options.scaleParameters ? unscaleStep(h, scale) : h;
+        const double stepNorm = delta.norm();
+        if (stepNorm <= m_options.stepTolerance * (x.norm() + m_options.stepTolerance)) return Termination::StepTooSmall;
+
+        writeParameters(cluster, x + delta);
+        evaluateResiduals(cluster, cache, trialR);
+        double trialCost = 0.5 * trialR.squaredNorm();
+
+        // L(0) - L(h) = -g^T h - ||J h||^2 / 2
+        double predicted = -g.dot(h) - 0.5 * multiply(cache, h).squaredNorm();
+        double rho = predicted > 0.0 ? (cost - trialCost) / predicted : -1.0;
+        const bool accepted = rho > 0.0 && std::isfinite(trialCost);
+        record(cache, cluster.iterations, residualNorm, stepNorm, radius, accepted);
+
+        if (rho > 0.75) radius = std::max(radius, 3.0 * h.norm());
+        else if (rho < 0.25) radius *= 0.5;
+
+        if (accepted) {
+            r.swap(trialR);
+            cost = trialCost;
+            jacobianCurrent = false;
+        } else {
+            writeParameters(cluster, x);
+        }
+    }
+
+    return r.norm() < m_options.residualTolerance ? Termination::Converged : Termination::MaxIterations;
+}
+
+void Solver::record(ClusterCache& cache, int iteration, double residualNorm, double stepNorm,
+                    double damping, bool accepted) const {
+    if (!m_options.recordIterations) return;
+
+    Iteration entry;
+    entry.iteration = iteration;
+    entry.residualNorm = residualNorm;
+    entry.stepNorm = stepNorm;
+    entry.damping = damping;
+    entry.accepted = accepted;
+    cache.log.push_back(entry);
+}
+
+void Solver::evaluateResiduals(const Cluster& cluster, ClusterCache& cache, Eigen::VectorXd& r) const {
+    ScopedTimer timer(cache.timings.evaluation);
+    size_t row = 0;
+    for (auto& batch : cache.batches) {
+        batch.evaluate(r.data() + row);
+        row += batch.size();
+    }
+    for (; row < cluster.constraints.size(); ++row) {
+        r(row) = m_constraints[cluster.constraints[row]]->evaluate();
+    }
+}
+
+void Solver::readParameters(const Cluster& cluster, Eigen::VectorXd& x) const {
+    for (size_t j = 0; j < cluster.parameters.size(); ++j) {
+        x(j) = *m_parameters[cluster.parameters[j]];
+    }
+}
+
+void Solver::writeParameters(const Cluster& cluster, const Eigen::VectorXd& x) const {
+    for (size_t j = 0; j < cluster.parameters.size(); ++j) {
+        *m_parameters[cluster.parameters[j]] = x(j);
+    }
+}
+
+void Solver::assembleJacobian(const Cluster& cluster, ClusterCache& cache, bool holdModified) const {
+    ScopedTimer timer(cache.timings.assembly);
+    // Batched rows refresh their partials at the current parameters first.
+    size_t batchRow = 0;
+    for (auto& batch : cache.batches) {
+        batch.evaluate(cache.batchResiduals.data() + batchRow, true);
+        batchRow += batch.size();
+    }
+
+    // A held parameter keeps its structural entries but contributes a zero
+    // column, so the minimum-norm step leaves it where the caller put it.
+    GradientRow row;
+    if (cache.sparse) {
+        double* values = cache.jacobian.valuePtr();
+        std::fill(values, values + cache.jacobian.nonZeros(), 0.0);
+        size_t e = 0;
+        for (const auto& batch : cache.batches) {
+            for (size_t t = 0; t < batch.size(); ++t) {
+                for (int k = 0; k < 4; ++k) {
+                    int col = batch.column(t, k);
+                    if (col < 0) continue;
+                    if (!(holdModified && m_modified[col])) values[cache.entryOffsets[e]] += batch.partial(t, k);
+                    ++e;
+                }
+            }
+        }
+        for (size_t i = cache.batchedRows; i < cluster.constraints.size(); ++i) {
+            row.clear();
+            m_constraints[cluster.constraints[i]]->getGradient(row);
+            for (int k = 0; k < row.size; ++k, ++e) {
+                if (holdModified && m_modified[row.indices[k]]) continue;
+                values[cache.entryOffsets[e]] += row.values[k];
+            }
+        }
+        return;
+    }
+
+    cache.dense.setZero();
+    size_t i = 0;
+    for (const auto& batch : cache.batches) {
+        for (size_t t = 0; t < batch.size(); ++t, ++i) {
+            for (int k = 0; k < 4; ++k) {
+                int col = batch.column(t, k);
+                if (col < 0 || (holdModified && m_modified[col])) continue;
+                cache.dense(i, m_localIndex[col]) += batch.partial(t, k);
+            }
+        }
+    }
+    for (; i < cluster.constraints.size(); ++i) {
+        row.clear();
+        m_constraints[cluster.constraints[i]]->getGradient(row);
+        for (int k = 0; k < row.size; ++k) {
+            if (holdModified && m_modified[row.indices[k]]) continue;
+            cache.dense(i, m_localIndex[row.indices[k]]) += row.values[k];
+        }
+    }
+}
+
+void Solver::scaleJacobian(ClusterCache& cache, Eigen::VectorXd& scale) const {
+    ScopedTimer timer(cache.timings.assembly);
+    // Moré's scaling: each column is divided by the largest norm it has had
+    // so far, which keeps the scaling monotone and the iteration stable.
+    if (cache.sparse) {
+        auto& J = cache.jacobian;
+        for (Eigen::Index j = 0; j < J.outerSize(); ++j) {
+            double norm = 0.0;
+            for (Eigen::SparseMatrix<double>::InnerIterator it(J, j); it; ++it) norm += it.value() * it.value();
+            scale(j) = std::max(scale(j), std::sqrt(norm));
+            if (scale(j) == 0.0) continue;
+            for (Eigen::SparseMatrix<double>::InnerIterator it(J, j); it; ++it) it.valueRef() /= scale(j);
+        }
+        return;
+    }
+
+    for (Eigen::Index j = 0; j < cache.dense.cols(); ++j) {
+        scale(j) = std::max(scale(j), cache.dense.col(j).norm());
+        if (scale(j) > 0.0) cache.dense.col(j) /= scale(j);
+    }
+}
+
+double Solver::maxColumnSquaredNorm(const ClusterCache& cache) const {
+    if (!cache.sparse) return cache.dense.colwise().squaredNorm().maxCoeff();
+
+    double result = 0.0;
+    const auto& J = cache.jacobian;
+    for (Eigen::Index j = 0; j < J.outerSize(); ++j) {
+        double norm = 0.0;
+        for (Eigen::SparseMatrix<double>::InnerIterator it(J, j); it; ++it) norm += it.value() * it.value();
+        result = std::max(result, norm);
+    }
+    return result;
+}
+
+Eigen::VectorXd Solver::multiply(const ClusterCache& cache, const Eigen::VectorXd& v) const {
+    if (cache.sparse) return cache.jacobian * v;
+    return cache.dense * v;
+}
+
+Eigen::VectorXd Solver::multiplyTransposed(const ClusterCache& cache, const Eigen::VectorXd& v) const {
+    if (cache.sparse) return cache.jacobian.transpose() * v;
+    return cache.dense.transpose() * v;
+}
+
+Eigen::VectorXd Solver::solveStep(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const {
+    ScopedTimer timer(cache.timings.factorization);
+    return cache.sparse ? solveSparse(cache, r, damping) : solveDense(cache, r, damping);
+}
+
+Eigen::VectorXd Solver::solveDense(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const {
+    const auto& J = cache.dense;
+    if (damping == 0.0) return J.completeOrthogonalDecomposition().solve(-r);
+
+    // Same damped step through whichever Gram matrix is smaller:
+    // (J^T J + mu I)^-1 J^T = J^T (J J^T + mu I)^-1
+    if (J.rows() <= J.cols()) {
+        Eigen::MatrixXd gram = J * J.transpose();
+        gram.diagonal().array() += damping;
+        return J.transpose() * gram.ldlt().solve(-r);
+    }
+    Eigen::MatrixXd gram = J.transpose() * J;
+    gram.diagonal().array() += damping;
+    return gram.ldlt().solve(J.transpose() * -r);
+}
+
+Eigen::VectorXd Solver::solveSparse(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const {
+    const auto& J = cache.jacobian;
+
+    // Cholesky on the smaller of the two Gram matrices. For the usual
+    // under-constrained sketch (rows <= cols) this yields the minimum-norm
+    // step J^T (J J^T)^-1 (-r), matching the dense decomposition. A tiny
+    // diagonal shift keeps rank-deficient systems factorizable.
+    const bool wide = J.rows() <= J.cols();
+    Eigen::SparseMatrix<double> gram = wide ? Eigen::SparseMatrix<double>(J * J.transpose())
+                                            : Eigen::SparseMatrix<double>(J.transpose() * J);
+
+    // The Jacobian pattern is fixed, so the symbolic analysis only has to be
+    // redone if the product's pattern ever differs.
+    if (!cache.analyzed || gram.nonZeros() != cache.gramNonZeros) {
+        cache.ldlt.analyzePattern(gram);
+        cache.gramNonZeros = gram.nonZeros();
+        cache.analyzed = true;
     }
+    cache.ldlt.setShift(damping + 1e-12 * (1.0 + gram.diagonal().cwiseAbs().maxCoeff()));
+    cache.ldlt.factorize(gram);
+    if (cache.ldlt.info() != Eigen::Success) return failedStep(J.cols());
 
-    return Status::Failed;
-}
\ No newline at end of file
+    if (wide) return J.transpose() * cache.ldlt.solve(-r);
+    return cache.ldlt.solve(J.transpose() * -r);
+}
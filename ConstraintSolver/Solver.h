@@ -3,28 +3,312 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <QJsonObject>
+#include <QString>
 #include "Constraint.h"
+#include "ConstraintBatch.h"
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseQR>
 
 class Solver {
 public:
     enum class Status { Solved, UnderConstrained, OverConstrained, Failed };
 
+    enum class Algorithm {
+        GaussNewton,        // full undamped steps
+        LevenbergMarquardt, // adaptive damping with step acceptance
+        Dogleg              // Powell's trust-region dogleg
+    };
+
+    struct Options {
+        Algorithm algorithm = Algorithm::GaussNewton;
+        int maxIterations = 50;
+        double residualTolerance = 1e-6;  // converged once ||r|| drops below
+        double stepTolerance = 1e-12;     // relative step size treated as stalled
+        double gradientTolerance = 1e-14; // ||J^T r||_inf treated as stationary
+        double initialDamping = 1e-3;     // LM: relative to max diag(J^T J)
+        double initialTrustRadius = 1.0;  // Dogleg: in scaled parameter units
+        // LM/Dogleg: scale each parameter by its Jacobian column norm so
+        // millimetre fillets and ten-metre frames take comparable steps.
+        bool scaleParameters = true;
+        // Evaluate built-in constraint types through vectorized batches
+        // rather than one virtual call per constraint.
+        bool batchKernels = true;
+        // Merge parameters that constraints only equate (coincident points,
+        // horizontal pairs) before solving, and drop those constraints from
+        // the numeric system.
+        bool eliminateEqualities = true;
+        // Log residual, step and damping of every iteration in the report.
+        bool recordIterations = true;
+        // After each cluster solve, factor its Jacobian with a rank-revealing
+        // QR to count free motions and find redundant or conflicting
+        // constraints. Status then follows from rank instead of comparing
+        // constraint and parameter counts.
+        bool analyzeRank = false;
+        double rankTolerance = 1e-9; // relative to the largest pivot
+    };
+
+    // Why a cluster's iteration stopped.
+    enum class Termination {
+        NotRun,
+        Converged,        // residual below tolerance
+        MaxIterations,
+        StepTooSmall,     // relative step below stepTolerance
+        Stationary,       // gradient below gradientTolerance
+        SingularStep,     // linear solve produced a non-finite step
+        NoFreeParameters  // residual left but nothing to move
+    };
+
+    // Wall-clock seconds spent in each phase of the iteration.
+    struct Timings {
+        double evaluation = 0.0;    // residuals, including trial points
+        double assembly = 0.0;      // Jacobian fill and scaling
+        double factorization = 0.0; // normal equations and step solve
+    };
+
+    struct Iteration {
+        int cluster = 0;
+        int iteration = 0;
+        double residualNorm = 0.0; // before the step
+        double stepNorm = 0.0;     // in parameter units
+        double damping = 0.0;      // LM damping or dogleg trust radius; 0 for Gauss-Newton
+        bool accepted = true;
+    };
+
+    // A connected component of the constraint/parameter graph. Indices refer
+    // to the order in which constraints and parameters were added.
+    struct Cluster {
+        std::vector<int> constraints;
+        std::vector<int> parameters;
+        Status status = Status::Failed;
+        Termination termination = Termination::NotRun;
+        int iterations = 0;
+
+        // Filled with analyzeRank only; -1 otherwise.
+        int rank = -1;
+        int freedom = -1;
+        std::vector<int> redundant;   // dependent on others and satisfied
+        std::vector<int> conflicting; // dependent on others and violated
+    };
+
+    struct ClusterReport {
+        int cluster = 0;
+        size_t rows = 0;
+        size_t columns = 0;
+        size_t nonZeros = 0; // Jacobian entries, structural for sparse clusters
+        bool sparse = false;
+        Status status = Status::Failed;
+        Termination termination = Termination::NotRun;
+        int iterations = 0;
+        int freedom = -1;
+        size_t redundant = 0;
+        size_t conflicting = 0;
+        Timings timings;
+    };
+
+    // What the last solve() or resolve() did, for diagnosing stalls and
+    // tracking regressions. Clusters not re-solved by resolve() are omitted.
+    struct Report {
+        Status status = Status::Solved;
+        bool incremental = false;
+        size_t parameters = 0;
+        size_t constraints = 0;
+        size_t eliminatedParameters = 0;
+        size_t eliminatedConstraints = 0;
+        size_t clusterCount = 0;
+        size_t nonZeros = 0;
+        double prepareSeconds = 0.0;
+        double totalSeconds = 0.0;
+        Timings timings; // summed over clusters, so may exceed totalSeconds when parallel
+        std::vector<ClusterReport> clusters;
+        std::vector<Iteration> iterations;
+
+        QJsonObject toJson() const;
+        // One line per iteration, with a header row.
+        std::string toCsv() const;
+        // Writes CSV for a ".csv" path and JSON otherwise.
+        bool save(const QString& path) const;
+    };
+
+    static const char* toString(Status status);
+    static const char* toString(Termination termination);
+
+    // Clusters with at least this many parameters are assembled as a sparse
+    // Jacobian and solved through the normal equations instead of a dense
+    // complete orthogonal decomposition.
+    static constexpr size_t DefaultSparseThreshold = 100;
+
+    // Smaller systems are solved on the calling thread; spinning up workers
+    // costs more than it saves.
+    static constexpr size_t ParallelThreshold = 2000;
+
+    // Largest null-space basis (parameters x free motions) kept per cluster
+    // for freedom() queries. Bigger clusters only report their total.
+    static constexpr size_t NullSpaceBudget = size_t(1) << 22;
+
     Solver() = default;
 
     void addConstraint(std::shared_ptr<Constraint> constraint) {
         m_constraints.push_back(constraint);
+        m_prepared = false;
     }
 
     void addParameter(double* param) {
         m_parameters.push_back(param);
+        m_prepared = false;
+    }
+
+    void clear();
+
+    // 0 forces the sparse path, SIZE_MAX forces the dense one.
+    void setSparseThreshold(size_t threshold) { m_sparseThreshold = threshold; m_prepared = false; }
+    size_t sparseThreshold() const { return m_sparseThreshold; }
+
+    void setOptions(const Options& options) {
+        // Batching and elimination shape the prepared system.
+        if (options.batchKernels != m_options.batchKernels ||
+            options.eliminateEqualities != m_options.eliminateEqualities) {
+            m_prepared = false;
+        }
+        m_options = options;
     }
+    const Options& options() const { return m_options; }
 
+    // 0 uses one worker per hardware thread.
+    void setThreadCount(unsigned count) { m_threadCount = count; }
+    unsigned threadCount() const { return m_threadCount; }
+
+    // Solves every cluster, starting from the current parameter values.
     Status solve();
 
+    // Records that the caller wrote to a parameter. The next solve() or
+    // resolve() holds it at its new value where the system allows.
+    void markModified(const double* param);
+
+    // Re-solves only the clusters containing parameters passed to
+    // markModified(), reusing the index map, sparsity pattern and symbolic
+    // factorization of the previous solve. Falls back to solve() after
+    // constraints or parameters were added.
+    Status resolve();
+
+    // Per-cluster results of the last solve() or resolve().
+    const std::vector<Cluster>& clusters() const { return m_clusters; }
+
+    // Parameters merged into another and constraints dropped by the last
+    // preparation; both are zero with eliminateEqualities off.
+    size_t eliminatedParameters() const { return m_eliminatedParameters; }
+    size_t eliminatedConstraints() const { return m_eliminatedConstraints; }
+
+    const Report& report() const { return m_report; }
+
+    // Calls f(double*) for every parameter the last solve() or resolve() may
+    // have written, so callers can invalidate what depends on them.
+    template<typename F>
+    void forEachWrittenParameter(F f) const {
+        for (const auto& entry : m_report.clusters) {
+            for (int j : m_clusters[entry.cluster].parameters) f(m_parameters[j]);
+            for (int j : m_caches[entry.cluster].aliases) f(m_parameters[j]);
+        }
+        for (int j : m_writtenOutsideClusters) f(m_parameters[j]);
+    }
+
+    // Runs the rank analysis on every cluster solved since it last ran, as
+    // analyzeRank would have, and updates statuses to follow from rank.
+    // Lets interactive edits keep analyzeRank off and diagnose once the
+    // edit is over.
+    Status analyze();
+
+    // Degrees of freedom left to a set of parameters, such as one entity's:
+    // the dimension of the clusters' null space restricted to them. Needs
+    // analyzeRank or analyze() after the last solve; -1 if unknown.
+    int freedom(const std::vector<double*>& params) const;
+
+    // Constraint indices flagged by the last analysis, over all clusters.
+    std::vector<int> redundantConstraints() const;
+    std::vector<int> conflictingConstraints() const;
+
 private:
+    // Structure reused across solves of one cluster; only values change.
+    struct ClusterCache {
+        bool sparse = false;
+        bool analyzed = false;
+        Eigen::MatrixXd dense;
+        Eigen::SparseMatrix<double> jacobian;
+        std::vector<int> entryOffsets; // value index of each gradient entry, in row order
+        Eigen::Index gramNonZeros = 0;
+        Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt;
+        std::vector<ConstraintBatch> batches; // cover the cluster's first rows
+        size_t batchedRows = 0;
+        Eigen::VectorXd batchResiduals;
+        std::vector<int> aliases; // merged parameters copied from their representative after a solve
+        Timings timings;
+        std::vector<Iteration> log;
+        Eigen::MatrixXd nullSpace; // orthonormal, one row per cluster column
+        bool nullSpaceKnown = false;
+        bool rankKnown = false; // analyzed since the cluster was last solved
+    };
+
+    void prepare();
+    void bindParameters();
+    void eliminateEqualities();
+    void copyAliases(const std::vector<int>& aliases) const;
+    void buildClusters();
+    void buildBatches(Cluster& cluster, ClusterCache& cache) const;
+    void buildSparsePattern(const Cluster& cluster, ClusterCache& cache) const;
+    void solveAndReport(const std::vector<int>& which);
+    void solveClusters(const std::vector<int>& which);
+    void solveCluster(Cluster& cluster, ClusterCache& cache, bool holdModified) const;
+    Termination solveGaussNewton(Cluster& cluster, ClusterCache& cache, bool holdModified) const;
+    Termination solveLevenbergMarquardt(Cluster& cluster, ClusterCache& cache, bool holdModified) const;
+    Termination solveDogleg(Cluster& cluster, ClusterCache& cache, bool holdModified) const;
+    void analyzeCluster(Cluster& cluster, ClusterCache& cache) const;
+    void rankStatus(Cluster& cluster) const;
+    void record(ClusterCache& cache, int iteration, double residualNorm, double stepNorm,
+                double damping, bool accepted) const;
+    Status aggregateStatus() const;
+
+    void evaluateResiduals(const Cluster& cluster, ClusterCache& cache, Eigen::VectorXd& r) const;
+    void readParameters(const Cluster& cluster, Eigen::VectorXd& x) const;
+    void writeParameters(const Cluster& cluster, const Eigen::VectorXd& x) const;
+
+    void assembleJacobian(const Cluster& cluster, ClusterCache& cache, bool holdModified) const;
+    void scaleJacobian(ClusterCache& cache, Eigen::VectorXd& scale) const;
+    double maxColumnSquaredNorm(const ClusterCache& cache) const;
+    Eigen::VectorXd multiply(const ClusterCache& cache, const Eigen::VectorXd& v) const;
+    Eigen::VectorXd multiplyTransposed(const ClusterCache& cache, const Eigen::VectorXd& v) const;
+
+    // Minimizes ||J h + r||^2 + damping ||h||^2; damping 0 gives the
+    // minimum-norm Gauss-Newton step.
+    Eigen::VectorXd solveStep(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const;
+    Eigen::VectorXd solveDense(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const;
+    Eigen::VectorXd solveSparse(ClusterCache& cache, const Eigen::VectorXd& r, double damping) const;
+
     std::vector<std::shared_ptr<Constraint>> m_constraints;
     std::vector<double*> m_parameters;
+    Options m_options;
+    size_t m_sparseThreshold = DefaultSparseThreshold;
+    unsigned m_threadCount = 0;
+
+    bool m_prepared = false;
+    ParameterIndexMap m_indices;
+    std::vector<Cluster> m_clusters;
+    std::vector<ClusterCache> m_caches;
+    std::vector<int> m_clusterOf;  // cluster of each parameter, -1 if unconstrained
+    std::vector<int> m_localIndex; // column of each parameter within its cluster
+    std::vector<int> m_representative; // parameter each one is merged into, itself if none
+    std::vector<char> m_eliminated;    // constraints satisfied by merging parameters
+    std::vector<int> m_freeAliases;    // merged parameters whose group is in no cluster
+    bool m_freeAliasesDirty = false;
+    std::vector<int> m_pendingWrites;          // unclustered parameters markModified wrote through
+    std::vector<int> m_writtenOutsideClusters; // the same, plus free aliases copied, for the last solve
+    size_t m_eliminatedParameters = 0;
+    size_t m_eliminatedConstraints = 0;
+    std::vector<char> m_modified;
+    std::vector<int> m_dirtyClusters;
+    Report m_report;
 };
 
 #endif
@@ -0,0 +1,111 @@
+#include "Solver.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <sstream>
+
+const char* Solver::toString(Status status) {
+    switch (status) {
+        case Status::Solved:           return "Solved";
+        case Status::UnderConstrained: return "UnderConstrained";
+        case Status::OverConstrained:  return "OverConstrained";
+        case Status::Failed:           return "Failed";
+    }
+    return "Unknown";
+}
+
+const char* Solver::toString(Termination termination) {
+    switch (termination) {
+        case Termination::NotRun:           return "NotRun";
+        case Termination::Converged:        return "Converged";
+        case Termination::MaxIterations:    return "MaxIterations";
+        case Termination::StepTooSmall:     return "StepTooSmall";
+        case Termination::Stationary:       return "Stationary";
+        case Termination::SingularStep:     return "SingularStep";
+        case Termination::NoFreeParameters: return "NoFreeParameters";
+    }
+    return "Unknown";
+}
+
+namespace {
+
+QJsonObject timingsToJson(const Solver::Timings& timings) {
+    QJsonObject json;
+    json["evaluation"] = timings.evaluation;
+    json["assembly"] = timings.assembly;
+    json["factorization"] = timings.factorization;
+    return json;
+}
+
+}
+
+QJsonObject Solver::Report::toJson() const {
+    QJsonObject json;
+    json["status"] = toString(status);
+    json["incremental"] = incremental;
+    json["parameters"] = static_cast<double>(parameters);
+    json["constraints"] = static_cast<double>(constraints);
+    json["eliminatedParameters"] = static_cast<double>(eliminatedParameters);
+    json["eliminatedConstraints"] = static_cast<double>(eliminatedConstraints);
+    json["clusterCount"] = static_cast<double>(clusterCount);
+    json["nonZeros"] = static_cast<double>(nonZeros);
+    json["prepareSeconds"] = prepareSeconds;
+    json["totalSeconds"] = totalSeconds;
+    json["timings"] = timingsToJson(timings);
+
+    QJsonArray clusterArray;
+    for (const auto& cluster : clusters) {
+        QJsonObject entry;
+        entry["cluster"] = cluster.cluster;
+        entry["rows"] = static_cast<double>(cluster.rows);
+        entry["columns"] = static_cast<double>(cluster.columns);
+        entry["nonZeros"] = static_cast<double>(cluster.nonZeros);
+        entry["sparse"] = cluster.sparse;
+        entry["status"] = toString(cluster.status);
+        entry["termination"] = toString(cluster.termination);
+        entry["iterations"] = cluster.iterations;
+        entry["freedom"] = cluster.freedom;
+        entry["redundant"] = static_cast<double>(cluster.redundant);
+        entry["conflicting"] = static_cast<double>(cluster.conflicting);
+        entry["timings"] = timingsToJson(cluster.timings);
+        clusterArray.append(entry);
+    }
+    json["clusters"] = clusterArray;
+
+    QJsonArray iterationArray;
+    for (const auto& iteration : iterations) {
+        QJsonObject entry;
+        entry["cluster"] = iteration.cluster;
+        entry["iteration"] = iteration.iteration;
+        entry["residualNorm"] = iteration.residualNorm;
+        entry["stepNorm"] = iteration.stepNorm;
+        entry["damping"] = iteration.damping;
+        entry["accepted"] = iteration.accepted;
+        iterationArray.append(entry);
+    }
+    json["iterations"] = iterationArray;
+    return json;
+}
+
+std::string Solver::Report::toCsv() const {
+    std::ostringstream out;
+    out.precision(17);
+    out << "cluster,iteration,residual_norm,step_norm,damping,accepted\n";
+    for (const auto& iteration : iterations) {
+        out << iteration.cluster << ',' << iteration.iteration << ',' << iteration.residualNorm << ','
+            << iteration.stepNorm << ',' << iteration.damping << ',' << (iteration.accepted ? 1 : 0) << '\n';
+    }
+    return out.str();
+}
+
+bool Solver::Report::save(const QString& path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    if (path.endsWith(".csv", Qt::CaseInsensitive)) {
+        file.write(QByteArray::fromStdString(toCsv()));
+    } else {
+        file.write(QJsonDocument(toJson()).toJson());
+    }
+    return true;
+}
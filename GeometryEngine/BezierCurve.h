@@ -3,38 +3,51 @@
 
 #include "GeometricEntity.h"
 #include "Point.h"
+#include "Tessellation.h"
+#include "DrawBatch.h"
+#include <algorithm>
 #include <memory>
 #include <vector>
+#include <limits>
+#include <cmath>
 #include <QPainter>
-#include <QPainterPath>
-#include <QPainterPathStroker>
 #include <QJsonArray>
 
 class BezierCurve : public GeometricEntity {
 private:
     std::vector<std::shared_ptr<Point>> m_controlPoints;
+    TessellationCache m_outline;
 
 public:
     BezierCurve(const std::vector<std::shared_ptr<Point>>& controlPoints)
         : m_controlPoints(controlPoints) {}
 
     void draw(QPainter& painter) const override {
+        drawFlattened(painter, Tessellation::drawTolerance(painter));
+    }
+
+    // Selected curves draw their handles with a dashed pen, on their own but
+    // at the batch's flattening, which prepareDraw() built.
+    bool batch(DrawBatch& batch) const override {
+        if (m_selected) {
+            batch.flush();
+            drawFlattened(batch.painter(), batch.drawTolerance());
+        } else if (m_controlPoints.size() >= 2) {
+            batch.setStyle({m_color, 2 * m_thickness});
+            batch.addPolyline(outline(batch.drawTolerance()), false);
+        }
+        return true;
+    }
+
+    void prepareDraw(double tolerance) const override {
+        if (m_controlPoints.size() >= 2) outline(tolerance);
+    }
+
+    void drawFlattened(QPainter& painter, double tolerance) const {
         if (m_controlPoints.size() < 2) return;
 
         painter.setPen(QPen(m_selected ? Qt::cyan : m_color, 2 * m_thickness));
-        QPainterPath path;
-        path.moveTo(m_controlPoints[0]->x(), m_controlPoints[0]->y());
-
-        if (m_controlPoints.size() == 4) {
-            path.cubicTo(m_controlPoints[1]->x(), m_controlPoints[1]->y(),
-                         m_controlPoints[2]->x(), m_controlPoints[2]->y(),
-                         m_controlPoints[3]->x(), m_controlPoints[3]->y());
-        } else {
-            for (size_t i = 1; i < m_controlPoints.size(); ++i) {
-                path.lineTo(m_controlPoints[i]->x(), m_controlPoints[i]->y());
-            }
-        }
-        painter.drawPath(path);
+        painter.drawPolyline(outline(tolerance));
 
         if (m_selected) {
             painter.setPen(QPen(Qt::gray, 1, Qt::DashLine));
@@ -50,36 +63,134 @@ public:
 
     bool contains(const QPointF& point, double tolerance) const override {
         if (m_controlPoints.size() < 2) return false;
-        
+        const QRectF& box = boundingRect();
+        if (point.x() < box.left() - tolerance || point.x() > box.right() + tolerance ||
+            point.y() < box.top() - tolerance || point.y() > box.bottom() + tolerance) return false;
+        // Clicking a control point selects the curve too.
         for (const auto& cp : m_controlPoints) {
-            if (std::hypot(cp->x() - point.x(), cp->y() - point.y()) <= tolerance)
-                return true;
+            if (std::hypot(cp->x() - point.x(), cp->y() - point.y()) <= tolerance) return true;
+        }
+        if (m_controlPoints.size() != 4) {
+            return Tessellation::distance(outline(tolerance * Tessellation::HitFlatness), point, false) <= tolerance;
         }
-        
-        QPainterPath path;
-        path.moveTo(m_controlPoints[0]->x(), m_controlPoints[0]->y());
-        if (m_controlPoints.size() == 4) {
-            path.cubicTo(m_controlPoints[1]->x(), m_controlPoints[1]->y(),
-                         m_controlPoints[2]->x(), m_controlPoints[2]->y(),
-                         m_controlPoints[3]->x(), m_controlPoints[3]->y());
-        } else {
-            for (size_t i = 1; i < m_controlPoints.size(); ++i) {
-                path.lineTo(m_controlPoints[i]->x(), m_controlPoints[i]->y());
+        return distance(point) <= tolerance;
+    }
+
+    double distance(const QPointF& point) const override {
+        if (m_controlPoints.size() < 2) return std::numeric_limits<double>::infinity();
+
+        // Other degrees measure against a fine flattening, made per thread
+        // rather than in the shared outline cache.
+        if (m_controlPoints.size() != 4) {
+            QRectF box = computeBoundingRect();
+            double extent = std::max({box.width(), box.height(), 1e-9});
+            thread_local std::vector<QPointF> points;
+            thread_local QPolygonF flat;
+            points.clear();
+            for (const auto& cp : m_controlPoints) points.emplace_back(cp->x(), cp->y());
+            flat.clear();
+            Tessellation::bezier(flat, points.data(), static_cast<int>(points.size()), 1e-4 * extent);
+            return Tessellation::distance(flat, point, false);
+        }
+
+        const double x[4] = {m_controlPoints[0]->x(), m_controlPoints[1]->x(), m_controlPoints[2]->x(), m_controlPoints[3]->x()};
+        const double y[4] = {m_controlPoints[0]->y(), m_controlPoints[1]->y(), m_controlPoints[2]->y(), m_controlPoints[3]->y()};
+        return std::sqrt(cubicSquaredDistance(x, y, point.x(), point.y()));
+    }
+
+    bool shape(QPolygonF& out, double tolerance) const override {
+        if (m_controlPoints.size() < 2) return false;
+        thread_local std::vector<QPointF> points;
+        points.clear();
+        for (const auto& cp : m_controlPoints) points.emplace_back(cp->x(), cp->y());
+        Tessellation::bezier(out, points.data(), static_cast<int>(points.size()), tolerance);
+        return false;
+    }
+
+    QRectF computeBoundingRect() const override {
+        if (m_controlPoints.empty()) return QRectF();
+        double minX = m_controlPoints[0]->x(), maxX = minX;
+        double minY = m_controlPoints[0]->y(), maxY = minY;
+        auto include = [&](double x, double y) {
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+        };
+
+        if (m_controlPoints.size() != 4) {
+            for (const auto& cp : m_controlPoints) include(cp->x(), cp->y());
+            return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+        }
+
+        // Endpoints plus wherever either coordinate's derivative vanishes,
+        // rather than the looser control-point hull.
+        const double x[4] = {m_controlPoints[0]->x(), m_controlPoints[1]->x(), m_controlPoints[2]->x(), m_controlPoints[3]->x()};
+        const double y[4] = {m_controlPoints[0]->y(), m_controlPoints[1]->y(), m_controlPoints[2]->y(), m_controlPoints[3]->y()};
+        auto at = [](const double* c, double t) {
+            double u = 1.0 - t;
+            return u*u*u*c[0] + 3*u*u*t*c[1] + 3*u*t*t*c[2] + t*t*t*c[3];
+        };
+        include(x[3], y[3]);
+        double roots[4];
+        int count = 0;
+        for (const double* c : {x, y}) {
+            // B'(t)/3 = a t^2 + b t + d
+            double a = -c[0] + 3*c[1] - 3*c[2] + c[3];
+            double b = 2 * (c[0] - 2*c[1] + c[2]);
+            double d = c[1] - c[0];
+            if (std::abs(a) < 1e-12) {
+                if (std::abs(b) > 1e-12) roots[count++] = -d / b;
+            } else {
+                double disc = b*b - 4*a*d;
+                if (disc >= 0.0) {
+                    double s = std::sqrt(disc);
+                    roots[count++] = (-b + s) / (2*a);
+                    roots[count++] = (-b - s) / (2*a);
+                }
             }
         }
-        
-        QPainterPath strokedPath = QPainterPathStroker().createStroke(path);
-        return path.toFillPolygon().containsPoint(point, Qt::OddEvenFill) || 
-               false; // Fallback
+        for (int i = 0; i < count; ++i) {
+            if (roots[i] > 0.0 && roots[i] < 1.0) include(at(x, roots[i]), at(y, roots[i]));
+        }
+        return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
     }
 
-    std::vector<double*> getParameters() override {
-        std::vector<double*> params;
-        for (auto& p : m_controlPoints) {
-            auto subParams = p->getParameters();
-            params.insert(params.end(), subParams.begin(), subParams.end());
+    // Selected curves also draw their control polygon and handles.
+    QRectF drawnRect() const override {
+        QRectF rect = GeometricEntity::drawnRect();
+        if (m_selected) {
+            for (const auto& cp : m_controlPoints) {
+                rect |= QRectF(cp->x() - 2.5, cp->y() - 2.5, 5.0, 5.0);
+            }
         }
-        return params;
+        return rect;
+    }
+
+    // The curve flattened to within tolerance, for drawing and hit tests.
+    const QPolygonF& outline(double tolerance) const {
+        return m_outline.get(geometryVersion(), tolerance, [this](QPolygonF& out, double tol) {
+            std::vector<QPointF> points;
+            points.reserve(m_controlPoints.size());
+            for (const auto& cp : m_controlPoints) points.emplace_back(cp->x(), cp->y());
+            Tessellation::bezier(out, points.data(), static_cast<int>(points.size()), tol);
+        });
+    }
+
+    void visitParameters(ParameterVisitor visit) override {
+        for (auto& p : m_controlPoints) p->visitParameters(visit);
+    }
+
+    void adoptParameters(ParameterStore& store) override {
+        for (auto& p : m_controlPoints) p->adoptParameters(store);
+    }
+
+    void releaseParameters(ParameterStore& store) override {
+        for (auto& p : m_controlPoints) p->releaseParameters(store);
+    }
+
+    // Children's caches go stale with ours: they share the parameters.
+    void markDirty() override {
+        GeometricEntity::markDirty();
+        for (auto& p : m_controlPoints) p->markDirty();
     }
 
     EntityType getType() const override { return EntityType::BezierCurve; }
@@ -97,16 +208,116 @@ public:
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
-        m_controlPoints.clear();
+    // Fills the existing control points in place, as the factory creates
+    // them up front; only missing ones are allocated, in arena.
+    void fromJson(const QJsonObject& json, EntityArena* arena) override {
         QJsonArray points = json["controlPoints"].toArray();
+        m_controlPoints.resize(std::min<size_t>(m_controlPoints.size(), points.size()));
         for (int i = 0; i < points.size(); ++i) {
-            auto p = std::make_shared<Point>(0, 0);
-            p->fromJson(points[i].toObject());
-            m_controlPoints.push_back(p);
+            if (static_cast<size_t>(i) == m_controlPoints.size()) m_controlPoints.push_back(EntityArena::make<Point>(arena, 0, 0));
+            m_controlPoints[i]->fromJson(points[i].toObject(), arena);
         }
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
+    }
+private:
+    // Roots of the distance quintic closer than this in t are one root.
+    static constexpr double RootMerge = 1e-12;
+
+    // Roots in [0, 1] of the polynomial sum c[i] t^i of degree n <= 5, in
+    // increasing order. Between consecutive roots of its derivative the
+    // polynomial is monotone, so each such interval holds at most one root,
+    // which safeguarded Newton refines. Roots closer than RootMerge are
+    // reported once, so at most n are written; roots must hold n + 1 for
+    // safety. No allocation.
+    static int unitRoots(const double* c, int n, double* roots) {
+        while (n > 0 && c[n] == 0.0) --n;
+        if (n == 0) return 0;
+        if (n == 1) {
+            const double t = -c[0] / c[1];
+            if (t < 0.0 || t > 1.0) return 0;
+            roots[0] = t;
+            return 1;
+        }
+
+        double d[5];
+        for (int i = 1; i <= n; ++i) d[i - 1] = i * c[i];
+        auto value = [](const double* p, int degree, double t) {
+            double v = p[degree];
+            for (int i = degree - 1; i >= 0; --i) v = v * t + p[i];
+            return v;
+        };
+
+        double ends[7]; // 0, up to n - 1 (+ 1 spare) derivative roots, 1
+        ends[0] = 0.0;
+        int m = 1 + unitRoots(d, n - 1, ends + 1);
+        ends[m++] = 1.0;
+
+        // Newton may stop an ulp short of a root that is also an interval
+        // end, such as t = 1 when the point lies on the last control point.
+        int count = 0;
+        auto add = [&](double t) {
+            if (count > 0 && t - roots[count - 1] <= RootMerge) return;
+            if (count <= n) roots[count++] = t;
+        };
+        for (int k = 0; k + 1 < m; ++k) {
+            double a = ends[k], b = ends[k + 1];
+            const double fa = value(c, n, a);
+            if (fa == 0.0) {
+                add(a);
+                continue;
+            }
+            if ((fa < 0.0) == (value(c, n, b) < 0.0)) continue;
+
+            double t = 0.5 * (a + b);
+            for (int i = 0; i < 64; ++i) {
+                const double f = value(c, n, t);
+                if (f == 0.0) break;
+                if ((f < 0.0) == (fa < 0.0)) a = t; else b = t;
+                const double df = value(d, n - 1, t);
+                double next = df != 0.0 ? t - f / df : 0.5 * (a + b);
+                if (!(next > a && next < b)) next = 0.5 * (a + b);
+                if (std::abs(next - t) <= 1e-15) { t = next; break; }
+                t = next;
+            }
+            add(t);
+        }
+        if (value(c, n, 1.0) == 0.0) add(1.0);
+        return count;
+    }
+
+    // Squared distance from (px, py) to a cubic: the closest point is an
+    // endpoint or a root of the quintic (B(t) - p) . B'(t), all of which
+    // unitRoots() isolates, so no local minimum is missed.
+    static double cubicSquaredDistance(const double* x, const double* y, double px, double py) {
+        // Power basis: B(t) = a t^3 + b t^2 + c t + d
+        const double ax = -x[0] + 3*x[1] - 3*x[2] + x[3], ay = -y[0] + 3*y[1] - 3*y[2] + y[3];
+        const double bx = 3*x[0] - 6*x[1] + 3*x[2],       by = 3*y[0] - 6*y[1] + 3*y[2];
+        const double cx = 3*(x[1] - x[0]),                cy = 3*(y[1] - y[0]);
+        const double dx = x[0] - px,                      dy = y[0] - py;
+
+        auto squared = [&](double t) {
+            double ex = ((ax*t + bx)*t + cx)*t + dx;
+            double ey = ((ay*t + by)*t + cy)*t + dy;
+            return ex*ex + ey*ey;
+        };
+
+        // (a t^3 + b t^2 + c t + d) . (3a t^2 + 2b t + c), lowest power first.
+        const double quintic[6] = {
+            cx*dx + cy*dy,
+            cx*cx + cy*cy + 2*(bx*dx + by*dy),
+            3*(bx*cx + by*cy) + 3*(ax*dx + ay*dy),
+            4*(ax*cx + ay*cy) + 2*(bx*bx + by*by),
+            5*(ax*bx + ay*by),
+            3*(ax*ax + ay*ay)
+        };
+        double roots[6];
+        const int count = unitRoots(quintic, 5, roots);
+
+        double best = std::min(squared(0.0), squared(1.0));
+        for (int i = 0; i < count; ++i) best = std::min(best, squared(roots[i]));
+        return best;
     }
 };
 
@@ -0,0 +1,70 @@
+#ifndef BOUNDSARRAY_H
+#define BOUNDSARRAY_H
+
+#include <QRectF>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SpatialIndex.h"
+
+// Exact entity bounds stored as separate coordinate arrays, so a batch
+// query is one tight loop over contiguous doubles that the compiler
+// vectorises. Complements SpatialIndex, which wins for small regions.
+class BoundsArray {
+public:
+    size_t size() const { return m_minX.size(); }
+
+    void push_back(const QRectF& bounds) {
+        m_minX.push_back(0.0);
+        m_minY.push_back(0.0);
+        m_maxX.push_back(0.0);
+        m_maxY.push_back(0.0);
+        set(size() - 1, bounds);
+    }
+
+    void set(size_t i, const QRectF& bounds) {
+        SpatialIndex::Box box(bounds);
+        m_minX[i] = box.minX;
+        m_minY[i] = box.minY;
+        m_maxX[i] = box.maxX;
+        m_maxY[i] = box.maxY;
+    }
+
+    SpatialIndex::Box box(size_t i) const {
+        return SpatialIndex::Box(m_minX[i], m_minY[i], m_maxX[i], m_maxY[i]);
+    }
+
+    bool inside(size_t i, const SpatialIndex::Box& region) const {
+        return region.contains(box(i));
+    }
+
+    bool overlaps(size_t i, const SpatialIndex::Box& region) const {
+        return m_minX[i] <= region.maxX && region.minX <= m_maxX[i] &&
+               m_minY[i] <= region.maxY && region.minY <= m_maxY[i];
+    }
+
+    // mask[i] = 1 for each box in [begin, end) lying inside region, else 0.
+    // Branch-free so it compiles to packed compares.
+    void inside(const SpatialIndex::Box& region, size_t begin, size_t end, uint8_t* mask) const {
+        const double* minX = m_minX.data();
+        const double* minY = m_minY.data();
+        const double* maxX = m_maxX.data();
+        const double* maxY = m_maxY.data();
+        for (size_t i = begin; i < end; ++i) {
+            mask[i] = static_cast<uint8_t>((minX[i] >= region.minX) & (minY[i] >= region.minY) &
+                                           (maxX[i] <= region.maxX) & (maxY[i] <= region.maxY));
+        }
+    }
+
+    void clear() {
+        m_minX.clear();
+        m_minY.clear();
+        m_maxX.clear();
+        m_maxY.clear();
+    }
+
+private:
+    std::vector<double> m_minX, m_minY, m_maxX, m_maxY;
+};
+
+#endif
@@ -3,14 +3,18 @@
 
 #include "GeometricEntity.h"
 #include "Point.h"
+#include "Tessellation.h"
+#include "DrawBatch.h"
 #include <memory>
 #include <QPainter>
 #include <cmath>
+#include <limits>
 
 class Circle : public GeometricEntity {
 private:
     std::shared_ptr<Point> m_center;
-    double m_radius;
+    Parameter m_radius;
+    TessellationCache m_outline;
 
 public:
     Circle(std::shared_ptr<Point> center, double radius)
@@ -20,51 +24,98 @@ public:
         if (m_center) {
             painter.setPen(QPen(m_selected ? Qt::cyan : m_color, 2 * m_thickness));
             painter.setBrush(Qt::NoBrush);
-            painter.drawEllipse(QPointF(m_center->x(), m_center->y()), m_radius, m_radius);
+            painter.drawPolygon(outline(Tessellation::drawTolerance(painter)));
         }
     }
 
+    bool batch(DrawBatch& batch) const override {
+        if (m_center) {
+            batch.setStyle({m_selected ? Qt::cyan : m_color, 2 * m_thickness});
+            batch.addPolyline(outline(batch.drawTolerance()), true);
+        }
+        return true;
+    }
+
+    void prepareDraw(double tolerance) const override {
+        if (m_center) outline(tolerance);
+    }
+
     bool contains(const QPointF& point, double tolerance) const override {
         if (!m_center) return false;
+        return distance(point) <= tolerance;
+    }
+
+    double distance(const QPointF& point) const override {
+        if (!m_center) return std::numeric_limits<double>::infinity();
         double dx = m_center->x() - point.x();
         double dy = m_center->y() - point.y();
         double dist = std::sqrt(dx*dx + dy*dy);
-        return std::abs(dist - m_radius) <= tolerance;
+        return std::abs(dist - m_radius);
     }
 
-    std::vector<double*> getParameters() override {
-        std::vector<double*> params;
-        if (m_center) {
-            auto p = m_center->getParameters();
-            params.insert(params.end(), p.begin(), p.end());
-        }
-        params.push_back(&m_radius);
-        return params;
+    bool shape(QPolygonF& out, double tolerance) const override {
+        if (!m_center) return false;
+        Tessellation::ellipse(out, QPointF(m_center->x(), m_center->y()), m_radius, m_radius, tolerance);
+        return true;
+    }
+
+    QRectF computeBoundingRect() const override {
+        if (!m_center) return QRectF();
+        return QRectF(m_center->x() - m_radius, m_center->y() - m_radius, 2 * m_radius, 2 * m_radius);
+    }
+
+    // The outline flattened to within tolerance. Hit tests stay analytic.
+    const QPolygonF& outline(double tolerance) const {
+        return m_outline.get(geometryVersion(), tolerance, [this](QPolygonF& out, double tol) {
+            Tessellation::ellipse(out, QPointF(m_center->x(), m_center->y()), m_radius, m_radius, tol);
+        });
+    }
+
+    void visitParameters(ParameterVisitor visit) override {
+        if (m_center) m_center->visitParameters(visit);
+        visit(m_radius.data());
+    }
+
+    void adoptParameters(ParameterStore& store) override {
+        if (m_center) m_center->adoptParameters(store);
+        m_radius.adopt(store, ParameterStore::Kind::Radius);
+    }
+
+    void releaseParameters(ParameterStore& store) override {
+        if (m_center) m_center->releaseParameters(store);
+        m_radius.release(store, ParameterStore::Kind::Radius);
+    }
+
+    // Children's caches go stale with ours: they share the parameters.
+    void markDirty() override {
+        GeometricEntity::markDirty();
+        if (m_center) m_center->markDirty();
     }
 
     EntityType getType() const override { return EntityType::Circle; }
 
     std::shared_ptr<Point> center() const { return m_center; }
-    double radius() const { return m_radius; }
+    double radius() const { return m_radius.value(); }
 
     QJsonObject toJson() const override {
         QJsonObject json;
         json["type"] = "Circle";
         if (m_center) json["center"] = m_center->toJson();
-        json["radius"] = m_radius;
+        json["radius"] = m_radius.value();
         json["color"] = m_color.name();
         json["thickness"] = m_thickness;
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
+    void fromJson(const QJsonObject& json, EntityArena* arena) override {
         if (json.contains("center")) {
-            m_center = std::make_shared<Point>(0, 0);
-            m_center->fromJson(json["center"].toObject());
+            if (!m_center) m_center = EntityArena::make<Point>(arena, 0, 0);
+            m_center->fromJson(json["center"].toObject(), arena);
         }
         m_radius = json["radius"].toDouble();
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
     }
 };
 
@@ -0,0 +1,136 @@
+#ifndef DRAWBATCH_H
+#define DRAWBATCH_H
+
+#include <QColor>
+#include <QLineF>
+#include <QPainter>
+#include <QPainterPath>
+#include <QPolygonF>
+#include <algorithm>
+#include <vector>
+#include "Tessellation.h"
+
+// Screen-space simplifications for drawing dense sketches at any zoom, so
+// frame time follows the pixels covered rather than the entity count.
+// Sizes are in device-independent pixels. Off by default, as it changes
+// how the sketch looks; turn it on for sketches too dense to draw in full.
+struct LevelOfDetail {
+    bool enabled = false;
+
+    // Entities whose box spans fewer pixels than this are not drawn, but
+    // counted into square density cells of cellPixels; a cell holding
+    // cellSaturation of them is drawn opaque in the topmost one's colour.
+    double tinyPixels = 2.0;
+    int cellPixels = 2;
+    int cellSaturation = 4;
+
+    // Entities spanning fewer pixels than this flatten their curves to
+    // coarseFlatness instead of Tessellation::DrawFlatness.
+    double smallPixels = 32.0;
+    double coarseFlatness = 1.0;
+
+    // Pens thinner than this on screen are widened to it when zoomed out, so
+    // thin lines do not vanish. Pens are never narrowed.
+    double minPenPixels = 1.0;
+};
+
+// Collects the outlines of consecutive entities drawn with the same pen and
+// brush, and draws them with one drawLines() and one drawPath() instead of
+// a pen change and a call per entity. Entities are added in drawing order
+// and a style change flushes what came before, so stacking is unchanged.
+class DrawBatch {
+public:
+    struct Style {
+        QColor color;
+        double penWidth = 1.0;
+        bool filled = false; // brush in the pen's colour, else none
+
+        bool operator==(const Style& o) const {
+            return color == o.color && penWidth == o.penWidth && filled == o.filled;
+        }
+    };
+
+    // With lod, pens are kept at least its minPenPixels wide on screen.
+    explicit DrawBatch(QPainter& painter, const LevelOfDetail* lod = nullptr)
+        : m_painter(painter), m_scale(Tessellation::pixelScale(painter)),
+          m_drawTolerance(Tessellation::drawTolerance(painter)) {
+        if (lod) m_minPenPixels = lod->minPenPixels;
+        m_path.setFillRule(Qt::WindingFill); // overlapping dots stay filled
+    }
+    ~DrawBatch() { flush(); }
+
+    DrawBatch(const DrawBatch&) = delete;
+    DrawBatch& operator=(const DrawBatch&) = delete;
+
+    QPainter& painter() const { return m_painter; }
+
+    // Tessellation::drawTolerance() of the painter, worked out once.
+    double drawTolerance() const { return m_drawTolerance; }
+
+    // Chord error, in pixels, for curves added from now on.
+    void setFlatness(double pixels) {
+        m_drawTolerance = m_scale > 0.0 ? pixels / m_scale : pixels;
+    }
+
+    // Tessellation::pixelScale() of the painter.
+    double pixelScale() const { return m_scale; }
+
+    // Style of what is added next.
+    void setStyle(const Style& style) {
+        if (m_count > 0 && !(style == m_style)) flush();
+        m_style = style;
+    }
+
+    void addLine(const QPointF& a, const QPointF& b) {
+        m_lines.emplace_back(a, b);
+        added();
+    }
+
+    void addPolyline(const QPolygonF& polyline, bool closed) {
+        if (polyline.isEmpty()) return;
+        m_path.addPolygon(polyline);
+        if (closed) m_path.closeSubpath();
+        added();
+    }
+
+    void addEllipse(const QPointF& center, double rx, double ry) {
+        m_path.addEllipse(center, rx, ry);
+        added();
+    }
+
+    // Draws everything collected so far.
+    void flush() {
+        if (m_count == 0) return;
+        double penWidth = m_style.penWidth;
+        if (m_scale > 0.0) {
+            penWidth = std::max(m_minPenPixels, penWidth * m_scale) / m_scale;
+        }
+        m_painter.setPen(QPen(m_style.color, penWidth));
+        m_painter.setBrush(m_style.filled ? QBrush(m_style.color) : QBrush(Qt::NoBrush));
+        if (!m_lines.empty()) m_painter.drawLines(m_lines.data(), static_cast<int>(m_lines.size()));
+        if (!m_path.isEmpty()) m_painter.drawPath(m_path);
+        m_lines.clear();
+        m_path.clear();
+        m_path.setFillRule(Qt::WindingFill);
+        m_count = 0;
+    }
+
+private:
+    // Keeps one stroke from growing the stroker's buffers without bound.
+    static constexpr int MaxItems = 4096;
+
+    void added() {
+        if (++m_count >= MaxItems) flush();
+    }
+
+    QPainter& m_painter;
+    double m_scale;
+    double m_drawTolerance;
+    double m_minPenPixels = 0.0;
+    Style m_style;
+    std::vector<QLineF> m_lines;
+    QPainterPath m_path;
+    int m_count = 0;
+};
+
+#endif
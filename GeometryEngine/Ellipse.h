@@ -3,13 +3,58 @@
 
 #include "GeometricEntity.h"
 #include "Point.h"
+#include "Tessellation.h"
+#include "DrawBatch.h"
 #include <memory>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <QPainter>
 
 class Ellipse : public GeometricEntity {
 private:
     std::shared_ptr<Point> m_center;
-    double m_rx, m_ry;
+    Parameter m_rx, m_ry;
+    TessellationCache m_outline;
+
+    // Distance from (x, y), x, y >= 0, to the ellipse with semi-axes a >= b
+    // along x and y. The nearest point solves a monotone equation in one
+    // unknown, found by bisection, which stays robust near the axes and
+    // for very flat ellipses.
+    static double axisDistance(double a, double b, double x, double y) {
+        if (b <= 0.0) return std::hypot(std::max(0.0, x - a), y); // a segment
+        if (y > 0.0) {
+            if (x <= 0.0) return std::abs(y - b);
+            const double z0 = x / a, z1 = y / b;
+            const double g = z0 * z0 + z1 * z1 - 1.0;
+            if (g == 0.0) return 0.0;
+
+            const double r0 = (a / b) * (a / b);
+            const double n0 = r0 * z0;
+            double s0 = z1 - 1.0;
+            double s1 = g < 0.0 ? 0.0 : std::hypot(n0, z1) - 1.0;
+            double t = 0.0;
+            for (int i = 0; i < 200; ++i) {
+                t = 0.5 * (s0 + s1);
+                if (t == s0 || t == s1) break;
+                const double q0 = n0 / (t + r0), q1 = z1 / (t + 1.0);
+                const double h = q0 * q0 + q1 * q1 - 1.0;
+                if (h > 0.0) s0 = t;
+                else if (h < 0.0) s1 = t;
+                else break;
+            }
+            return std::hypot(r0 * x / (t + r0) - x, y / (t + 1.0) - y);
+        }
+
+        // On the major axis: inside the evolute the nearest point is off
+        // the axis, otherwise it is the vertex.
+        const double numer = a * x, denom = a * a - b * b;
+        if (numer < denom) {
+            const double xd = numer / denom;
+            return std::hypot(a * xd - x, b * std::sqrt(1.0 - xd * xd));
+        }
+        return std::abs(x - a);
+    }
 
 public:
     Ellipse(std::shared_ptr<Point> center, double rx, double ry)
@@ -19,28 +64,87 @@ public:
         if (m_center) {
             painter.setPen(QPen(m_selected ? Qt::cyan : m_color, 2 * m_thickness));
             painter.setBrush(Qt::NoBrush);
-            painter.drawEllipse(QPointF(m_center->x(), m_center->y()), m_rx, m_ry);
+            painter.drawPolygon(outline(Tessellation::drawTolerance(painter)));
+        }
+    }
+
+    bool batch(DrawBatch& batch) const override {
+        if (m_center) {
+            batch.setStyle({m_selected ? Qt::cyan : m_color, 2 * m_thickness});
+            batch.addPolyline(outline(batch.drawTolerance()), true);
         }
+        return true;
+    }
+
+    void prepareDraw(double tolerance) const override {
+        if (m_center) outline(tolerance);
     }
 
     bool contains(const QPointF& point, double tolerance) const override {
         if (!m_center) return false;
+        // Scaling by 1/rx, 1/ry shrinks lengths by at most 1/min(rx, ry), so
+        // the radial estimate never exceeds the true distance and rejects
+        // cheaply before the exact projection.
         double dx = point.x() - m_center->x();
         double dy = point.y() - m_center->y();
-        
         double val = (dx*dx) / (m_rx*m_rx) + (dy*dy) / (m_ry*m_ry);
-        return std::abs(std::sqrt(val) - 1.0) < (tolerance / std::min(m_rx, m_ry));
+        if (std::abs(std::sqrt(val) - 1.0) * std::min(std::abs(m_rx.value()), std::abs(m_ry.value())) > tolerance) return false;
+        return distance(point) <= tolerance;
     }
 
-    std::vector<double*> getParameters() override {
-        std::vector<double*> params;
-        if (m_center) {
-            auto p = m_center->getParameters();
-            params.insert(params.end(), p.begin(), p.end());
+    // The outline flattened to within tolerance, for drawing.
+    const QPolygonF& outline(double tolerance) const {
+        return m_outline.get(geometryVersion(), tolerance, [this](QPolygonF& out, double tol) {
+            Tessellation::ellipse(out, QPointF(m_center->x(), m_center->y()), m_rx, m_ry, tol);
+        });
+    }
+
+    // Exact distance to the outline, by projecting onto the ellipse.
+    double distance(const QPointF& point) const override {
+        if (!m_center) return std::numeric_limits<double>::infinity();
+        double dx = std::abs(point.x() - m_center->x());
+        double dy = std::abs(point.y() - m_center->y());
+        double a = std::abs(m_rx.value()), b = std::abs(m_ry.value());
+        if (a < b) {
+            std::swap(a, b);
+            std::swap(dx, dy);
         }
-        params.push_back(&m_rx);
-        params.push_back(&m_ry);
-        return params;
+        return axisDistance(a, b, dx, dy);
+    }
+
+    bool shape(QPolygonF& out, double tolerance) const override {
+        if (!m_center) return false;
+        Tessellation::ellipse(out, QPointF(m_center->x(), m_center->y()), m_rx, m_ry, tolerance);
+        return true;
+    }
+
+    QRectF computeBoundingRect() const override {
+        if (!m_center) return QRectF();
+        return QRectF(m_center->x() - m_rx, m_center->y() - m_ry, 2 * m_rx, 2 * m_ry);
+    }
+
+    void visitParameters(ParameterVisitor visit) override {
+        if (m_center) m_center->visitParameters(visit);
+        visit(m_rx.data());
+        visit(m_ry.data());
+    }
+
+    void adoptParameters(ParameterStore& store) override {
+        if (m_center) m_center->adoptParameters(store);
+        m_rx.adopt(store, ParameterStore::Kind::Radius);
+        m_ry.adopt(store, ParameterStore::Kind::Radius);
+    }
+
+    void releaseParameters(ParameterStore& store) override {
+        if (m_center) m_center->releaseParameters(store);
+        m_rx.release(store, ParameterStore::Kind::Radius);
+        m_ry.release(store, ParameterStore::Kind::Radius);
+    }
+
+    // Children's caches go stale with ours: they share the parameters.
+    void markDirty() override {
+        GeometricEntity::markDirty();
+        if (m_center) m_center->markDirty();
     }
 
     EntityType getType() const override { return EntityType::Ellipse; }
@@ -49,22 +153,23 @@ public:
         QJsonObject json;
         json["type"] = "Ellipse";
         if (m_center) json["center"] = m_center->toJson();
-        json["rx"] = m_rx;
-        json["ry"] = m_ry;
+        json["rx"] = m_rx.value();
+        json["ry"] = m_ry.value();
         json["color"] = m_color.name();
         json["thickness"] = m_thickness;
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
+    void fromJson(const QJsonObject& json, EntityArena* arena) override {
         if (json.contains("center")) {
-            m_center = std::make_shared<Point>(0, 0);
-            m_center->fromJson(json["center"].toObject());
+            if (!m_center) m_center = EntityArena::make<Point>(arena, 0, 0);
+            m_center->fromJson(json["center"].toObject(), arena);
         }
         m_rx = json["rx"].toDouble();
         m_ry = json["ry"].toDouble();
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
     }
 };
 
@@ -0,0 +1,149 @@
+#ifndef ENTITYARENA_H
+#define ENTITYARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A pooled allocator for entities: one chunked pool per concrete type, so
+// entities of a type created together sit next to each other and bulk
+// creation, drawing and saving walk memory mostly linearly. It changes
+// where entities live, not how they are held: each is still an ordinary
+// owning shared_ptr with atomic reference counts, sharing one pooled slot
+// with its control block instead of a separate heap allocation, and
+// teardown still destroys them one by one. The pools stay alive until the
+// arena and the last entity allocated from it are gone, so entities may
+// outlive the sketch. A freed slot is reused by the next entity of its type.
+//
+// Entities may be created and dropped on any thread; the pools take a lock.
+class EntityArena {
+public:
+    static constexpr size_t ChunkSize = 1024;
+
+    EntityArena() : m_pools(std::make_shared<Pools>()) {}
+    EntityArena(const EntityArena&) = delete;
+    EntityArena& operator=(const EntityArena&) = delete;
+
+    template<typename T, typename... Args>
+    std::shared_ptr<T> create(Args&&... args) {
+        return std::allocate_shared<T>(Allocator<T>(m_pools), std::forward<Args>(args)...);
+    }
+
+    // create() in arena, or make_shared() without one.
+    template<typename T, typename... Args>
+    static std::shared_ptr<T> make(EntityArena* arena, Args&&... args) {
+        if (arena) return arena->create<T>(std::forward<Args>(args)...);
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+private:
+    // Fixed-size slots carved from chunks of ChunkSize, with a free list
+    // threaded through released slots.
+    class Pool {
+    public:
+        Pool(size_t size, size_t align)
+            : m_size(std::max(size, sizeof(void*))), m_align(std::max(align, alignof(void*))) {
+            m_size = (m_size + m_align - 1) / m_align * m_align;
+        }
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+
+        ~Pool() {
+            for (void* chunk : m_chunks) ::operator delete(chunk, std::align_val_t(m_align));
+        }
+
+        void* allocate() {
+            if (m_free) {
+                void* slot = m_free;
+                m_free = *static_cast<void**>(slot);
+                return slot;
+            }
+            if (m_used == ChunkSize || m_chunks.empty()) {
+                m_chunks.push_back(::operator new(m_size * ChunkSize, std::align_val_t(m_align)));
+                m_used = 0;
+            }
+            return static_cast<char*>(m_chunks.back()) + m_size * m_used++;
+        }
+
+        void deallocate(void* slot) {
+            *static_cast<void**>(slot) = m_free;
+            m_free = slot;
+        }
+
+    private:
+        size_t m_size;
+        size_t m_align;
+        std::vector<void*> m_chunks;
+        size_t m_used = 0; // slots handed out from the last chunk
+        void* m_free = nullptr;
+    };
+
+    struct Pools {
+        std::mutex mutex; // guards pools and every Pool in it
+        std::vector<std::unique_ptr<Pool>> pools;
+
+        template<typename U>
+        Pool& pool() {
+            const uint32_t index = poolIndex<U>();
+            if (pools.size() <= index) pools.resize(index + 1);
+            if (!pools[index]) pools[index] = std::make_unique<Pool>(sizeof(U), alignof(U));
+            return *pools[index];
+        }
+    };
+
+    // Hands allocate_shared one slot for the entity and its control block.
+    // Every copy, including the one kept in each control block, holds the
+    // pools alive.
+    template<typename U>
+    class Allocator {
+    public:
+        using value_type = U;
+
+        explicit Allocator(std::shared_ptr<Pools> pools) : m_pools(std::move(pools)) {}
+        template<typename V>
+        Allocator(const Allocator<V>& other) : m_pools(other.m_pools) {}
+
+        U* allocate(size_t n) {
+            if (n != 1) return static_cast<U*>(::operator new(n * sizeof(U), std::align_val_t(alignof(U))));
+            std::lock_guard<std::mutex> lock(m_pools->mutex);
+            return static_cast<U*>(m_pools->template pool<U>().allocate());
+        }
+
+        void deallocate(U* p, size_t n) {
+            if (n != 1) {
+                ::operator delete(p, std::align_val_t(alignof(U)));
+                return;
+            }
+            std::lock_guard<std::mutex> lock(m_pools->mutex);
+            m_pools->template pool<U>().deallocate(p);
+        }
+
+        template<typename V>
+        bool operator==(const Allocator<V>& o) const { return m_pools == o.m_pools; }
+        template<typename V>
+        bool operator!=(const Allocator<V>& o) const { return m_pools != o.m_pools; }
+
+    private:
+        template<typename V> friend class Allocator;
+        std::shared_ptr<Pools> m_pools;
+    };
+
+    // Process-wide id per allocated type, assigned on first use.
+    template<typename U>
+    static uint32_t poolIndex() {
+        static const uint32_t index = s_nextPool++;
+        return index;
+    }
+
+    static inline std::atomic<uint32_t> s_nextPool{0};
+
+    std::shared_ptr<Pools> m_pools;
+};
+
+#endif
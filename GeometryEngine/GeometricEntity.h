@@ -3,9 +3,16 @@
 
 #include <CGAL/Simple_cartesian.h>
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
 #include <QPainter> 
 #include <QJsonObject>
 #include <QColor>
+#include "ParameterStore.h"
+#include "EntityArena.h"
+
+class DrawBatch;
 
 typedef CGAL::Simple_cartesian<double> Kernel;
 typedef Kernel::Point_2 Point_2;
@@ -19,33 +26,140 @@ enum class EntityType {
     BezierCurve 
 };
 
+// Non-owning reference to a callable taking a double*, so parameters can
+// be visited through a virtual call without allocating. Must not outlive
+// the callable it was made from.
+class ParameterVisitor {
+public:
+    template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, ParameterVisitor>::value>>
+    ParameterVisitor(F& f)
+        : m_object(&f), m_call([](void* object, double* param) { (*static_cast<F*>(object))(param); }) {}
+
+    void operator()(double* param) const { m_call(m_object, param); }
+
+private:
+    void* m_object;
+    void (*m_call)(void*, double*);
+};
+
 class GeometricEntity {
 protected:
     bool m_selected = false;
     QColor m_color = Qt::black;
     double m_thickness = 1.0;
 
+private:
+    uint64_t m_version = 0;
+    uint64_t m_geometryVersion = 0;
+    mutable QRectF m_bounds;
+    mutable bool m_boundsValid = false;
+
 public:
     virtual ~GeometricEntity() = default;
 
     virtual void draw(QPainter& painter) const = 0;
 
-    virtual std::vector<double*> getParameters() = 0;
+    // Adds exactly what draw() would paint to batch.painter() and returns
+    // true, or returns false if draw() must be called instead.
+    virtual bool batch(DrawBatch&) const { return false; }
+
+    // Builds the caches batch() reads when flattening to tolerance, so that
+    // threads drawing the entity at once afterwards only read them.
+    virtual void prepareDraw(double) const {}
+
+    // Calls visit(double*) for each parameter, child points first.
+    virtual void visitParameters(ParameterVisitor visit) = 0;
+
+    template<typename F>
+    void forEachParameter(F f) {
+        visitParameters(ParameterVisitor(f));
+    }
+
+    // The i-th parameter in visiting order, or null.
+    double* parameter(size_t i) {
+        double* found = nullptr;
+        size_t n = 0;
+        forEachParameter([&](double* param) { if (n++ == i) found = param; });
+        return found;
+    }
+
+    // Allocates; prefer forEachParameter() on hot paths.
+    std::vector<double*> getParameters() {
+        std::vector<double*> params;
+        forEachParameter([&](double* param) { params.push_back(param); });
+        return params;
+    }
+
+    // Moves the entity's parameters into a sketch's store, and back inline
+    // when that sketch is destroyed, returning their slots to the store.
+    virtual void adoptParameters(ParameterStore& store) = 0;
+    virtual void releaseParameters(ParameterStore& store) = 0;
 
     virtual EntityType getType() const = 0;
 
     virtual QJsonObject toJson() const = 0;
-    virtual void fromJson(const QJsonObject& json) = 0;
+    // Points the entity lacks are created in arena, or on the heap if null.
+    virtual void fromJson(const QJsonObject& json, EntityArena* arena) = 0;
 
     virtual bool contains(const QPointF& point, double tolerance) const = 0;
+
+    // Distance from point to the drawn outline. Batch queries call this
+    // from several threads at once, so it must not touch shared caches.
+    virtual double distance(const QPointF& point) const = 0;
+
+    // Appends the outline as a polyline within tolerance of it, for region
+    // queries the bounding box cannot decide, and returns whether it closes
+    // back to its start. Like distance(), called from several threads at
+    // once. The default is the bounding box itself.
+    virtual bool shape(QPolygonF& out, double /*tolerance*/) const {
+        const QRectF box = computeBoundingRect();
+        out << box.topLeft() << box.topRight() << box.bottomRight() << box.bottomLeft();
+        return true;
+    }
+
+    // Tight axis-aligned box around the drawn outline, ignoring pen width.
+    virtual QRectF computeBoundingRect() const = 0;
+
+    // computeBoundingRect(), cached until the next markDirty().
+    const QRectF& boundingRect() const {
+        if (!m_boundsValid) {
+            m_bounds = computeBoundingRect();
+            m_boundsValid = true;
+        }
+        return m_bounds;
+    }
+
+    // Box around every pixel draw() may touch: the outline widened by the
+    // pen, whose square caps reach past corners by up to sqrt(2) half-widths.
+    virtual QRectF drawnRect() const {
+        double reach = 1.5 * m_thickness;
+        return boundingRect().adjusted(-reach, -reach, reach, reach);
+    }
+
+    // Parameters are written through raw pointers, so whoever writes them
+    // (the sketch, after a solve or edit) must call this. Bumps version(),
+    // which caches derived from the entity's geometry or look compare against,
+    // and geometryVersion().
+    virtual void markDirty() {
+        ++m_version;
+        ++m_geometryVersion;
+        m_boundsValid = false;
+    }
+    uint64_t version() const { return m_version; }
+
+    // Changes with the shape only, not with selection or colour, so caches
+    // of the outline survive hovering and selecting.
+    uint64_t geometryVersion() const { return m_geometryVersion; }
     
-    void setSelected(bool selected) { m_selected = selected; }
+    void setSelected(bool selected) {
+        if (selected != m_selected) { m_selected = selected; ++m_version; }
+    }
     bool isSelected() const { return m_selected; }
 
-    void setColor(QColor color) { m_color = color; }
+    void setColor(QColor color) { m_color = color; ++m_version; }
     QColor color() const { return m_color; }
 
-    void setThickness(double thickness) { m_thickness = thickness; }
+    void setThickness(double thickness) { m_thickness = thickness; markDirty(); }
     double thickness() const { return m_thickness; }
 };
 
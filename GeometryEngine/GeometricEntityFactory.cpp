@@ -6,12 +6,32 @@
 #include "RegularPolygon.h"
 #include "BezierCurve.h"
 
-std::shared_ptr<GeometricEntity> GeometricEntityFactory::createEntity(const std::string& type) {
-    if (type == "Point") return std::make_shared<Point>(0, 0);
-    if (type == "Line") return std::make_shared<Line>(nullptr, nullptr);
-    if (type == "Circle") return std::make_shared<Circle>(nullptr, 0);
-    if (type == "Ellipse") return std::make_shared<Ellipse>(nullptr, 0, 0);
-    if (type == "RegularPolygon") return std::make_shared<RegularPolygon>(nullptr, 0, 3);
-    if (type == "BezierCurve") return std::make_shared<BezierCurve>(std::vector<std::shared_ptr<Point>>{});
+template<typename T, typename... Args>
+static std::shared_ptr<T> make(EntityArena* arena, Args&&... args) {
+    if (arena) return arena->create<T>(std::forward<Args>(args)...);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+// Composite entities get their points up front so fromJson() fills them in
+// place rather than allocating new ones.
+std::shared_ptr<GeometricEntity> GeometricEntityFactory::createEntity(const std::string& type, EntityArena* arena) {
+    if (type == "Point") return make<Point>(arena, 0, 0);
+    if (type == "Line") return make<Line>(arena, make<Point>(arena, 0, 0), make<Point>(arena, 0, 0));
+    if (type == "Circle") return make<Circle>(arena, make<Point>(arena, 0, 0), 0);
+    if (type == "Ellipse") return make<Ellipse>(arena, make<Point>(arena, 0, 0), 0, 0);
+    if (type == "RegularPolygon") return make<RegularPolygon>(arena, make<Point>(arena, 0, 0), 0, 3);
+    if (type == "BezierCurve") return make<BezierCurve>(arena, std::vector<std::shared_ptr<Point>>{});
     return nullptr;
 }
+
+std::shared_ptr<GeometricEntity> GeometricEntityFactory::createEntity(const QJsonObject& json, EntityArena* arena) {
+    const std::string type = json["type"].toString().toStdString();
+    if (type == "BezierCurve") {
+        std::vector<std::shared_ptr<Point>> points;
+        const int count = json["controlPoints"].toArray().size();
+        points.reserve(count);
+        for (int i = 0; i < count; ++i) points.push_back(make<Point>(arena, 0, 0));
+        return make<BezierCurve>(arena, points);
+    }
+    return createEntity(type, arena);
+}
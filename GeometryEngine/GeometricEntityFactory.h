@@ -3,11 +3,19 @@
 
 #include <memory>
 #include <string>
+#include <QJsonArray>
+#include <QJsonObject>
 #include "GeometricEntity.h"
+#include "EntityArena.h"
 
 class GeometricEntityFactory {
 public:
-    static std::shared_ptr<GeometricEntity> createEntity(const std::string& type);
+    // With an arena, the entity and its points are created there.
+    static std::shared_ptr<GeometricEntity> createEntity(const std::string& type, EntityArena* arena = nullptr);
+
+    // As above for json's "type", with as many control points as json
+    // holds, ready for fromJson().
+    static std::shared_ptr<GeometricEntity> createEntity(const QJsonObject& json, EntityArena* arena = nullptr);
 };
 
 #endif
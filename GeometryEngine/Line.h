@@ -3,7 +3,9 @@
 
 #include "GeometricEntity.h"
 #include "Point.h"
+#include "DrawBatch.h"
 #include <memory>
+#include <limits>
 #include <QPainter>
 
 class Line : public GeometricEntity {
@@ -23,33 +25,64 @@ public:
         }
     }
 
+    bool batch(DrawBatch& batch) const override {
+        if (m_start && m_end) {
+            batch.setStyle({m_selected ? Qt::cyan : m_color, 2 * m_thickness});
+            batch.addLine(QPointF(m_start->x(), m_start->y()), QPointF(m_end->x(), m_end->y()));
+        }
+        return true;
+    }
+
     bool contains(const QPointF& point, double tolerance) const override {
         if (!m_start || m_end == nullptr) return false;
-        
+        return distance(point) <= tolerance;
+    }
+
+    double distance(const QPointF& point) const override {
+        if (!m_start || !m_end) return std::numeric_limits<double>::infinity();
+
         QPointF p1(m_start->x(), m_start->y());
         QPointF p2(m_end->x(), m_end->y());
         
         // Distance from point to line segment
         double l2 = QPointF::dotProduct(p2 - p1, p2 - p1);
-        if (l2 == 0.0) return std::sqrt(QPointF::dotProduct(point - p1, point - p1)) <= tolerance;
+        if (l2 == 0.0) return std::sqrt(QPointF::dotProduct(point - p1, point - p1));
         
         double t = std::max(0.0, std::min(1.0, QPointF::dotProduct(point - p1, p2 - p1) / l2));
         QPointF projection = p1 + t * (p2 - p1);
-        double dist = std::sqrt(QPointF::dotProduct(point - projection, point - projection));
-        
-        return dist <= tolerance;
+        return std::sqrt(QPointF::dotProduct(point - projection, point - projection));
     }
-    std::vector<double*> getParameters() override {
-        std::vector<double*> params;
-        if (m_start) {
-            auto p = m_start->getParameters();
-            params.insert(params.end(), p.begin(), p.end());
-        }
-        if (m_end) {
-            auto p = m_end->getParameters();
-            params.insert(params.end(), p.begin(), p.end());
-        }
-        return params;
+
+    bool shape(QPolygonF& out, double) const override {
+        if (!m_start || !m_end) return false;
+        out << QPointF(m_start->x(), m_start->y()) << QPointF(m_end->x(), m_end->y());
+        return false;
+    }
+
+    QRectF computeBoundingRect() const override {
+        if (!m_start || !m_end) return QRectF();
+        return QRectF(QPointF(m_start->x(), m_start->y()), QPointF(m_end->x(), m_end->y())).normalized();
+    }
+    void visitParameters(ParameterVisitor visit) override {
+        if (m_start) m_start->visitParameters(visit);
+        if (m_end) m_end->visitParameters(visit);
+    }
+
+    void adoptParameters(ParameterStore& store) override {
+        if (m_start) m_start->adoptParameters(store);
+        if (m_end) m_end->adoptParameters(store);
+    }
+
+    void releaseParameters(ParameterStore& store) override {
+        if (m_start) m_start->releaseParameters(store);
+        if (m_end) m_end->releaseParameters(store);
+    }
+
+    // Children's caches go stale with ours: they share the parameters.
+    void markDirty() override {
+        GeometricEntity::markDirty();
+        if (m_start) m_start->markDirty();
+        if (m_end) m_end->markDirty();
     }
 
     EntityType getType() const override { return EntityType::Line; }
@@ -67,17 +100,18 @@ public:
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
+    void fromJson(const QJsonObject& json, EntityArena* arena) override {
         if (json.contains("start")) {
-            m_start = std::make_shared<Point>(0, 0);
-            m_start->fromJson(json["start"].toObject());
+            if (!m_start) m_start = EntityArena::make<Point>(arena, 0, 0);
+            m_start->fromJson(json["start"].toObject(), arena);
         }
         if (json.contains("end")) {
-            m_end = std::make_shared<Point>(0, 0);
-            m_end->fromJson(json["end"].toObject());
+            if (!m_end) m_end = EntityArena::make<Point>(arena, 0, 0);
+            m_end->fromJson(json["end"].toObject(), arena);
         }
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
     }
 };
 
@@ -0,0 +1,28 @@
+#include "ParameterStore.h"
+
+double* ParameterStore::allocate(Kind kind, double value) {
+    Column& c = column(kind);
+    if (!c.free.empty()) {
+        double* slot = c.free.back();
+        c.free.pop_back();
+        *slot = value;
+        return slot;
+    }
+    if (c.size == c.blocks.size() * BlockSize) {
+        c.blocks.emplace_back(new double[BlockSize]);
+    }
+    double* slot = c.blocks.back().get() + (c.size % BlockSize);
+    *slot = value;
+    ++c.size;
+    return slot;
+}
+
+void ParameterStore::release(Kind kind, double* slot) {
+    column(kind).free.push_back(slot);
+}
+
+size_t ParameterStore::size() const {
+    size_t total = 0;
+    for (const auto& c : m_columns) total += c.size - c.free.size();
+    return total;
+}
@@ -0,0 +1,91 @@
+#ifndef PARAMETERSTORE_H
+#define PARAMETERSTORE_H
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+// Contiguous storage for the solver-visible values of a sketch, one column
+// per kind of value. Columns grow in fixed-size blocks so a value never
+// moves once allocated; entities and the solver keep plain pointers to it.
+// Released slots go on their column's free list and are handed out again
+// before the column grows.
+class ParameterStore {
+public:
+    enum class Kind { X, Y, Radius, Rotation, Count };
+
+    static constexpr size_t BlockSize = 1024;
+
+    ParameterStore() = default;
+    ParameterStore(const ParameterStore&) = delete;
+    ParameterStore& operator=(const ParameterStore&) = delete;
+
+    double* allocate(Kind kind, double value);
+
+    // Returns a slot from allocate(kind) for reuse.
+    void release(Kind kind, double* slot);
+
+    // Slots in use.
+    size_t size(Kind kind) const { return column(kind).size - column(kind).free.size(); }
+    size_t size() const;
+
+    // Calls f(double* values, size_t count) for each filled block of a
+    // column, in allocation order. Released slots are included.
+    template<typename F>
+    void forEachBlock(Kind kind, F f) const {
+        const Column& c = column(kind);
+        for (size_t b = 0; b < c.blocks.size(); ++b) {
+            size_t count = (b + 1 < c.blocks.size()) ? BlockSize : c.size - b * BlockSize;
+            f(c.blocks[b].get(), count);
+        }
+    }
+
+private:
+    struct Column {
+        std::vector<std::unique_ptr<double[]>> blocks;
+        size_t size = 0; // slots ever handed out
+        std::vector<double*> free;
+    };
+
+    Column& column(Kind kind) { return m_columns[static_cast<size_t>(kind)]; }
+    const Column& column(Kind kind) const { return m_columns[static_cast<size_t>(kind)]; }
+
+    std::array<Column, static_cast<size_t>(Kind::Count)> m_columns;
+};
+
+// A single parameter value. It lives inline until its entity is added to a
+// sketch, then in that sketch's ParameterStore. Pointers from data() are
+// therefore only stable once the entity belongs to a sketch.
+class Parameter {
+public:
+    explicit Parameter(double value = 0.0) : m_local(value) {}
+    Parameter(const Parameter&) = delete;
+    Parameter& operator=(const Parameter&) = delete;
+
+    double value() const { return *m_value; }
+    operator double() const { return *m_value; }
+    Parameter& operator=(double value) { *m_value = value; return *this; }
+
+    double* data() { return m_value; }
+    bool isStored() const { return m_value != &m_local; }
+
+    void adopt(ParameterStore& store, ParameterStore::Kind kind) {
+        if (!isStored()) m_value = store.allocate(kind, m_local);
+    }
+
+    // Copies the value back inline and returns the slot to store, which
+    // must be the one passed to adopt().
+    void release(ParameterStore& store, ParameterStore::Kind kind) {
+        if (!isStored()) return;
+        m_local = *m_value;
+        store.release(kind, m_value);
+        m_value = &m_local;
+    }
+
+private:
+    double m_local;
+    double* m_value = &m_local;
+};
+
+#endif
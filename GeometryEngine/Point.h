@@ -2,16 +2,17 @@
 #define POINT_H
 
 #include "GeometricEntity.h"
+#include "DrawBatch.h"
 #include <QPainter>
 
 class Point : public GeometricEntity {
 private:
-    double m_x, m_y;
+    Parameter m_x, m_y;
 
 public:
     Point(double x, double y) : m_x(x), m_y(y) {}
-    double x() const { return m_x; }
-    double y() const { return m_y; }
+    double x() const { return m_x.value(); }
+    double y() const { return m_y.value(); }
 
     
     void draw(QPainter& painter) const override {
@@ -22,36 +23,78 @@ public:
         painter.drawEllipse(QPointF(m_x, m_y), size, size);
     }
 
+    bool batch(DrawBatch& batch) const override {
+        batch.setStyle({m_selected ? Qt::cyan : m_color, 1.0, true});
+        batch.addEllipse(QPointF(m_x, m_y), 3.0 * m_thickness, 3.0 * m_thickness);
+        return true;
+    }
+
     bool contains(const QPointF& point, double tolerance) const override {
+        return distance(point) <= tolerance;
+    }
+
+    double distance(const QPointF& point) const override {
         double dx = m_x - point.x();
         double dy = m_y - point.y();
         double size = 3.0 * m_thickness;
-        return std::sqrt(dx*dx + dy*dy) <= (tolerance + size);
+        return std::max(0.0, std::sqrt(dx*dx + dy*dy) - size);
+    }
+
+    // The dot's center; its size does not count for region queries.
+    bool shape(QPolygonF& out, double) const override {
+        out << QPointF(m_x, m_y);
+        return false;
+    }
+
+    QRectF computeBoundingRect() const override {
+        double size = 3.0 * m_thickness;
+        return QRectF(m_x - size, m_y - size, 2 * size, 2 * size);
+    }
+
+    // The bounds already hold the dot; only its one-unit outline pokes out.
+    QRectF drawnRect() const override {
+        return boundingRect().adjusted(-0.5, -0.5, 0.5, 0.5);
+    }
+
+    void visitParameters(ParameterVisitor visit) override {
+        visit(m_x.data());
+        visit(m_y.data());
+    }
+
+    // Direct access for constraints, which bind to a point's coordinates.
+    double* xParameter() { return m_x.data(); }
+    double* yParameter() { return m_y.data(); }
+
+    void adoptParameters(ParameterStore& store) override {
+        m_x.adopt(store, ParameterStore::Kind::X);
+        m_y.adopt(store, ParameterStore::Kind::Y);
     }
 
-    std::vector<double*> getParameters() override {
-        return { &m_x, &m_y };
+    void releaseParameters(ParameterStore& store) override {
+        m_x.release(store, ParameterStore::Kind::X);
+        m_y.release(store, ParameterStore::Kind::Y);
     }
     
     EntityType getType() const override { return EntityType::Point; }
     
-    Point_2 toCgalPoint() const { return Point_2(m_x, m_y); }
+    Point_2 toCgalPoint() const { return Point_2(x(), y()); }
 
     QJsonObject toJson() const override {
         QJsonObject json;
         json["type"] = "Point";
-        json["x"] = m_x;
-        json["y"] = m_y;
+        json["x"] = x();
+        json["y"] = y();
         json["color"] = m_color.name();
         json["thickness"] = m_thickness;
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
+    void fromJson(const QJsonObject& json, EntityArena*) override {
         m_x = json["x"].toDouble();
         m_y = json["y"].toDouble();
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
     }
 };
 
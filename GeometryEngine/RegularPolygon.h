@@ -3,16 +3,54 @@
 
 #include "GeometricEntity.h"
 #include "Point.h"
+#include "DrawBatch.h"
 #include <memory>
 #include <QPainter>
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 class RegularPolygon : public GeometricEntity {
 private:
     std::shared_ptr<Point> m_center;
-    double m_radius;
+    Parameter m_radius;
     int m_sides;
-    double m_rotation; // in radians
+    Parameter m_rotation; // in radians
+
+    mutable QPolygonF m_vertices;
+    mutable double m_verticesKey[5] = {NAN, NAN, NAN, NAN, NAN};
+
+    // Vertex i, from the signed radius; vertices() and the distance both
+    // use it, so a negative radius turns both the same way.
+    QPointF vertex(int i) const {
+        double angle = m_rotation + 2.0 * M_PI * i / m_sides;
+        return QPointF(m_center->x() + m_radius * std::cos(angle),
+                       m_center->y() + m_radius * std::sin(angle));
+    }
+
+    // Squared distance to the outline. By symmetry the nearest edge is the
+    // one whose sector around the center holds the point, so only that
+    // edge is tested. Its ends come from vertex(), not the vertices()
+    // cache, so batch queries may call this from several threads.
+    double squaredDistance(const QPointF& point) const {
+        double dx = point.x() - m_center->x();
+        double dy = point.y() - m_center->y();
+        double step = 2.0 * M_PI / m_sides;
+
+        // A negative radius puts vertex 0 opposite the rotation.
+        double first = m_rotation + (m_radius < 0.0 ? M_PI : 0.0);
+        double t = (std::atan2(dy, dx) - first) / step;
+        int i = static_cast<int>(std::floor(t)) % m_sides;
+        if (i < 0) i += m_sides;
+
+        QPointF a = vertex(i), b = vertex(i + 1);
+        double ex = b.x() - a.x(), ey = b.y() - a.y();
+        double length2 = ex * ex + ey * ey;
+        double u = length2 > 0.0 ? ((point.x() - a.x()) * ex + (point.y() - a.y()) * ey) / length2 : 0.0;
+        u = std::max(0.0, std::min(1.0, u));
+        double px = a.x() + u * ex - point.x(), py = a.y() + u * ey - point.y();
+        return px * px + py * py;
+    }
 
 public:
     RegularPolygon(std::shared_ptr<Point> center, double radius, int sides, double rotation = 0)
@@ -22,48 +60,93 @@ public:
         if (!m_center || m_sides < 3) return;
 
         painter.setPen(QPen(m_selected ? Qt::cyan : m_color, 2 * m_thickness));
-        QPolygonF polygon;
-        for (int i = 0; i < m_sides; ++i) {
-            double angle = m_rotation + 2.0 * M_PI * i / m_sides;
-            polygon << QPointF(m_center->x() + m_radius * std::cos(angle),
-                               m_center->y() + m_radius * std::sin(angle));
+        painter.setBrush(Qt::NoBrush);
+        painter.drawPolygon(vertices());
+    }
+
+    bool batch(DrawBatch& batch) const override {
+        if (m_center && m_sides >= 3) {
+            batch.setStyle({m_selected ? Qt::cyan : m_color, 2 * m_thickness});
+            batch.addPolyline(vertices(), true);
         }
-        painter.drawPolygon(polygon);
+        return true;
+    }
+
+    void prepareDraw(double) const override {
+        vertices();
     }
 
     bool contains(const QPointF& point, double tolerance) const override {
         if (!m_center || m_sides < 3) return false;
-        
-        // Check distance to edges
-        QPolygonF polygon;
-        for (int i = 0; i < m_sides; ++i) {
-            double angle = m_rotation + 2.0 * M_PI * i / m_sides;
-            polygon << QPointF(m_center->x() + m_radius * std::cos(angle),
-                               m_center->y() + m_radius * std::sin(angle));
-        }
-        
-        for (int i = 0; i < polygon.size(); ++i) {
-            QPointF p1 = polygon[i];
-            QPointF p2 = polygon[(i + 1) % polygon.size()];
-            
-            double l2 = QPointF::dotProduct(p2 - p1, p2 - p1);
-            double t = std::max(0.0, std::min(1.0, QPointF::dotProduct(point - p1, p2 - p1) / l2));
-            QPointF projection = p1 + t * (p2 - p1);
-            if (std::sqrt(QPointF::dotProduct(point - projection, point - projection)) <= tolerance)
-                return true;
-        }
-        return false;
+
+        // The outline lies in the annulus between the inscribed and
+        // circumscribed circles, which rejects most points without trig.
+        double r = std::abs(m_radius.value());
+        double dx = point.x() - m_center->x();
+        double dy = point.y() - m_center->y();
+        double d2 = dx * dx + dy * dy;
+        double outer = r + tolerance;
+        double inner = r * std::cos(M_PI / m_sides) - tolerance;
+        if (d2 > outer * outer || (inner > 0.0 && d2 < inner * inner)) return false;
+
+        return squaredDistance(point) <= tolerance * tolerance;
     }
 
-    std::vector<double*> getParameters() override {
-        std::vector<double*> params;
+    double distance(const QPointF& point) const override {
+        if (!m_center || m_sides < 3) return std::numeric_limits<double>::infinity();
+        return std::sqrt(squaredDistance(point));
+    }
+
+    // From vertex() rather than the vertices() cache, for thread safety.
+    bool shape(QPolygonF& out, double) const override {
+        if (!m_center || m_sides < 3) return false;
+        for (int i = 0; i < m_sides; ++i) out << vertex(i);
+        return true;
+    }
+
+    QRectF computeBoundingRect() const override {
+        if (!m_center || m_sides < 3) return QRectF();
+        return vertices().boundingRect();
+    }
+
+    // The corners, rebuilt only when center, radius, sides or rotation
+    // differ from the last call.
+    const QPolygonF& vertices() const {
+        const double key[5] = {m_center ? m_center->x() : 0.0, m_center ? m_center->y() : 0.0,
+                               m_radius.value(), m_rotation.value(), static_cast<double>(m_sides)};
+        if (std::equal(key, key + 5, m_verticesKey)) return m_vertices;
+
+        m_vertices.clear();
         if (m_center) {
-            auto p = m_center->getParameters();
-            params.insert(params.end(), p.begin(), p.end());
+            m_vertices.reserve(std::max(m_sides, 0));
+            for (int i = 0; i < m_sides; ++i) m_vertices << vertex(i);
         }
-        params.push_back(&m_radius);
-        params.push_back(&m_rotation);
-        return params;
+        std::copy(key, key + 5, m_verticesKey);
+        return m_vertices;
+    }
+
+    void visitParameters(ParameterVisitor visit) override {
+        if (m_center) m_center->visitParameters(visit);
+        visit(m_radius.data());
+        visit(m_rotation.data());
+    }
+
+    void adoptParameters(ParameterStore& store) override {
+        if (m_center) m_center->adoptParameters(store);
+        m_radius.adopt(store, ParameterStore::Kind::Radius);
+        m_rotation.adopt(store, ParameterStore::Kind::Rotation);
+    }
+
+    void releaseParameters(ParameterStore& store) override {
+        if (m_center) m_center->releaseParameters(store);
+        m_radius.release(store, ParameterStore::Kind::Radius);
+        m_rotation.release(store, ParameterStore::Kind::Rotation);
+    }
+
+    // Children's caches go stale with ours: they share the parameters.
+    void markDirty() override {
+        GeometricEntity::markDirty();
+        if (m_center) m_center->markDirty();
     }
 
     EntityType getType() const override { return EntityType::RegularPolygon; }
@@ -72,24 +155,25 @@ public:
         QJsonObject json;
         json["type"] = "RegularPolygon";
         if (m_center) json["center"] = m_center->toJson();
-        json["radius"] = m_radius;
+        json["radius"] = m_radius.value();
         json["sides"] = m_sides;
-        json["rotation"] = m_rotation;
+        json["rotation"] = m_rotation.value();
         json["color"] = m_color.name();
         json["thickness"] = m_thickness;
         return json;
     }
 
-    void fromJson(const QJsonObject& json) override {
+    void fromJson(const QJsonObject& json, EntityArena* arena) override {
         if (json.contains("center")) {
-            m_center = std::make_shared<Point>(0, 0);
-            m_center->fromJson(json["center"].toObject());
+            if (!m_center) m_center = EntityArena::make<Point>(arena, 0, 0);
+            m_center->fromJson(json["center"].toObject(), arena);
         }
         m_radius = json["radius"].toDouble();
         m_sides = json["sides"].toInt();
         m_rotation = json["rotation"].toDouble();
         if (json.contains("color")) m_color = QColor(json["color"].toString());
         if (json.contains("thickness")) m_thickness = json["thickness"].toDouble();
+        markDirty();
     }
 };
 
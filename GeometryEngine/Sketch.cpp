@@ -1,26 +1,585 @@
 #include "Sketch.h"
+#include <QImage>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <thread>
 
-Sketch::Sketch() {}
-Sketch::~Sketch() = default;
+Sketch::Sketch() = default;
+
+Sketch::~Sketch() {
+    // Entities and constraints can outlive the sketch. Constraints drop
+    // their pointers into the store and solver, and entities take their
+    // values back, before the store recycles the slots and is freed.
+    for (const auto& constraint : m_constraints) {
+        constraint->unbindParameters();
+    }
+    for (const auto& entity : m_entities) {
+        entity->releaseParameters(m_parameters);
+    }
+}
 
 void Sketch::addEntity(std::shared_ptr<GeometricEntity> entity) {
     if (entity) {
+        entity->adoptParameters(m_parameters);
+        const int index = static_cast<int>(m_entities.size());
+        entity->forEachParameter([&](double* param) { m_dependents.emplace(param, index); });
+        m_entityIndex[entity.get()] = index;
+        m_proxies.push_back(m_index.insert(entity->boundingRect(), index));
+        m_bounds.push_back(entity->boundingRect());
+        m_isChanged.push_back(0);
         m_entities.push_back(entity);
+        boundsChanged(index, entity->boundingRect());
+        m_solverValid = false;
+
+        // Inserting one at a time loosens the tree; rebuild it whenever the
+        // sketch has doubled, which keeps the total cost at O(N log N).
+        if (m_entities.size() >= 1024 && m_entities.size() >= 2 * m_indexRebuiltAt) {
+            m_index.rebuild();
+            m_indexRebuiltAt = m_entities.size();
+        }
     }
 }
 
+void Sketch::addConstraint(std::shared_ptr<Constraint> constraint) {
+    if (constraint) {
+        m_constraints.push_back(constraint);
+        m_solverValid = false;
+    }
+}
+
+// Entities that can batch join the current run; any other ends it and
+// draws itself, so the order on screen is the order in the sketch.
+static void drawInto(DrawBatch& batch, const GeometricEntity& entity) {
+    if (entity.batch(batch)) return;
+    batch.flush();
+    entity.draw(batch.painter());
+}
+
 void Sketch::draw(QPainter& painter) const {
+    DrawBatch batch(painter);
     for (const auto& entity : m_entities) {
         if (entity) {
-            entity->draw(painter);
+            drawInto(batch, *entity);
+        }
+    }
+}
+
+namespace {
+
+// Counts of sub-pixel entities per square screen cell, drawn as one image.
+// Cells are aligned to multiples of their size on screen, so a repaint of
+// part of the view lands on the same cells as a full one.
+class DensityCells {
+public:
+    // Beyond this many cells, as for a visible rect far larger than the
+    // screen, tiny entities are drawn as usual instead.
+    static constexpr size_t MaxCells = size_t(1) << 22;
+
+    DensityCells(const QPainter& painter, const QRectF& visible, const LevelOfDetail& lod)
+        : m_cell(std::max(1, lod.cellPixels)), m_saturation(std::max(1, lod.cellSaturation)),
+          m_transform(painter.transform()) {
+        if (!lod.enabled) return;
+        const QRectF area = m_transform.mapRect(visible);
+        if (area.isEmpty() || !(area.width() * area.height() <= double(MaxCells) * m_cell * m_cell)) return;
+        m_left = static_cast<int>(std::floor(area.left() / m_cell));
+        m_top = static_cast<int>(std::floor(area.top() / m_cell));
+        m_columns = static_cast<int>(std::ceil(area.right() / m_cell)) - m_left;
+        m_rows = static_cast<int>(std::ceil(area.bottom() / m_cell)) - m_top;
+        m_counts.assign(static_cast<size_t>(m_columns) * m_rows, 0);
+        m_colors.resize(m_counts.size());
+    }
+
+    bool active() const { return !m_counts.empty(); }
+
+    void add(const QPointF& world, QRgb color) {
+        const QPointF p = m_transform.map(world);
+        const int column = static_cast<int>(std::floor(p.x() / m_cell)) - m_left;
+        const int row = static_cast<int>(std::floor(p.y() / m_cell)) - m_top;
+        if (column < 0 || row < 0 || column >= m_columns || row >= m_rows) return;
+        const size_t i = static_cast<size_t>(row) * m_columns + column;
+        ++m_counts[i];
+        m_colors[i] = color;
+        m_any = true;
+    }
+
+    void draw(QPainter& painter) const {
+        if (!m_any) return;
+        QImage image(m_columns, m_rows, QImage::Format_ARGB32_Premultiplied);
+        for (int row = 0; row < m_rows; ++row) {
+            QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row));
+            for (int column = 0; column < m_columns; ++column) {
+                const size_t i = static_cast<size_t>(row) * m_columns + column;
+                const int alpha = std::min(m_counts[i], m_saturation) * 255 / m_saturation;
+                const QRgb c = m_colors[i];
+                line[column] = qPremultiply(qRgba(qRed(c), qGreen(c), qBlue(c), alpha));
+            }
         }
+        painter.save();
+        painter.resetTransform();
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        painter.drawImage(QRectF(m_left * m_cell, m_top * m_cell, m_columns * m_cell, m_rows * m_cell), image);
+        painter.restore();
     }
+
+private:
+    int m_cell;
+    int m_saturation;
+    QTransform m_transform;
+    int m_left = 0, m_top = 0, m_columns = 0, m_rows = 0;
+    std::vector<int> m_counts;
+    std::vector<QRgb> m_colors;
+    bool m_any = false;
+};
+
+} // namespace
+
+template<typename Visit>
+void Sketch::forEachDrawn(const QRectF& visible, double scale, const LevelOfDetail& lod, Visit visit) const {
+    const bool simplify = lod.enabled && scale > 0.0;
+
+    // Clamped pens and density cells can reach a little past the bounds.
+    double margin = m_drawMargin;
+    if (simplify) margin += (lod.tinyPixels + lod.cellPixels + lod.minPenPixels) / scale;
+    const SpatialIndex::Box region(visible.adjusted(-margin, -margin, margin, margin));
+
+    auto visitOne = [&](int i) {
+        double extent = std::numeric_limits<double>::infinity();
+        if (simplify) {
+            const SpatialIndex::Box box = m_bounds.box(i);
+            extent = std::max(box.maxX - box.minX, box.maxY - box.minY) * scale;
+        }
+        visit(i, extent);
+    };
+
+    // A view over most of the sketch draws most of it; walking the bounds
+    // in order then saves sorting what the tree returns.
+    if (scanBeatsIndex(region)) {
+        for (size_t i = 0; i < m_bounds.size(); ++i) {
+            if (m_bounds.overlaps(i, region)) visitOne(static_cast<int>(i));
+        }
+    } else {
+        std::vector<int> ids;
+        m_index.query(region.toRect(), [&](int id) {
+            if (m_bounds.overlaps(id, region)) ids.push_back(id);
+        });
+        std::sort(ids.begin(), ids.end());
+        for (int id : ids) visitOne(id);
+    }
+}
+
+// Chord error, in pixels, that an entity spanning extent pixels is drawn at.
+static double drawFlatness(double extent, const LevelOfDetail& lod) {
+    return lod.enabled && extent < lod.smallPixels ? lod.coarseFlatness : Tessellation::DrawFlatness;
+}
+
+void Sketch::draw(QPainter& painter, const QRectF& visible, const LevelOfDetail& lod) const {
+    DrawBatch batch(painter, lod.enabled ? &lod : nullptr);
+    DensityCells cells(painter, visible, lod);
+
+    forEachDrawn(visible, batch.pixelScale(), lod, [&](int i, double extent) {
+        const GeometricEntity& entity = *m_entities[i];
+        if (extent < lod.tinyPixels && cells.active()) {
+            const SpatialIndex::Box box = m_bounds.box(i);
+            QColor color = entity.isSelected() ? QColor(Qt::cyan) : entity.color();
+            cells.add(QPointF(0.5 * (box.minX + box.maxX), 0.5 * (box.minY + box.maxY)), color.rgb());
+            return;
+        }
+        batch.setFlatness(drawFlatness(extent, lod));
+        drawInto(batch, entity);
+    });
+
+    batch.flush();
+    cells.draw(painter);
+}
+
+void Sketch::prepareDraw(const QRectF& visible, double scale, const LevelOfDetail& lod) const {
+    forEachDrawn(visible, scale, lod, [&](int i, double extent) {
+        const double flatness = drawFlatness(extent, lod);
+        m_entities[i]->prepareDraw(scale > 0.0 ? flatness / scale : flatness);
+    });
 }
 
 const std::vector<std::shared_ptr<GeometricEntity>>& Sketch::getEntities() const {
     return m_entities;
 }
 
-void Sketch::update() {
-    // Solver logic to be added later
-}
\ No newline at end of file
+const std::vector<std::shared_ptr<Constraint>>& Sketch::getConstraints() const {
+    return m_constraints;
+}
+
+void Sketch::rebuildSolver() {
+    m_solver.clear();
+
+    // Entities may share points, so register each parameter only once.
+    std::unordered_set<double*> seen;
+    for (const auto& entity : m_entities) {
+        entity->forEachParameter([&](double* param) {
+            if (seen.insert(param).second) m_solver.addParameter(param);
+        });
+    }
+    for (const auto& constraint : m_constraints) {
+        m_solver.addConstraint(constraint);
+    }
+    m_solverValid = true;
+}
+
+Solver::Status Sketch::update() {
+    if (!m_solverValid) rebuildSolver();
+    Solver::Status status = m_solver.solve();
+    m_solver.forEachWrittenParameter([this](const double* p) { parameterWritten(p); });
+    refreshIndex();
+    return status;
+}
+
+Solver::Status Sketch::parameterChanged(double* param) {
+    parameterWritten(param);
+    if (m_constraints.empty()) {
+        refreshIndex();
+        return Solver::Status::Solved;
+    }
+    if (!m_solverValid) rebuildSolver();
+    m_solver.markModified(param);
+    Solver::Status status = m_solver.resolve();
+    m_solver.forEachWrittenParameter([this](const double* p) { parameterWritten(p); });
+    refreshIndex();
+    return status;
+}
+
+void Sketch::entityChanged(const std::shared_ptr<GeometricEntity>& entity) {
+    auto it = m_entityIndex.find(entity.get());
+    if (it == m_entityIndex.end()) return;
+    markChanged(it->second);
+    refreshIndex();
+}
+
+void Sketch::markChanged(int entity) {
+    if (m_isChanged[entity]) return;
+    m_isChanged[entity] = 1;
+    m_changed.push_back(entity);
+}
+
+void Sketch::parameterWritten(const double* param) {
+    auto range = m_dependents.equal_range(param);
+    for (auto it = range.first; it != range.second; ++it) markChanged(it->second);
+}
+
+// Leaves only move once an entity leaves its enlarged box, so most edits
+// just recompute a few bounds.
+void Sketch::refreshIndex() {
+    for (int i : m_changed) {
+        m_entities[i]->markDirty();
+        const QRectF& bounds = m_entities[i]->boundingRect();
+        m_index.update(m_proxies[i], bounds);
+        m_bounds.set(i, bounds);
+        boundsChanged(i, bounds);
+        m_isChanged[i] = 0;
+    }
+    m_changed.clear();
+}
+
+void Sketch::boundsChanged(int entity, const QRectF& bounds) {
+    const QRectF drawn = m_entities[entity]->drawnRect();
+    m_drawMargin = std::max({m_drawMargin, bounds.left() - drawn.left(), drawn.right() - bounds.right(),
+                             bounds.top() - drawn.top(), drawn.bottom() - bounds.bottom()});
+}
+
+// Batch queries below this many entities or points per chunk stay on the
+// calling thread.
+static constexpr size_t ScanGrain = size_t(1) << 15;
+static constexpr size_t NearestGrain = 256;
+
+// Regions covering at least this share of the sketch are scanned linearly
+// rather than through the tree, which would visit most of its nodes anyway.
+static constexpr double ScanCoverage = 0.125;
+static constexpr size_t ScanMinimum = 4096;
+
+// Runs work(begin, end) over [0, count) in chunks of grain, spread over
+// worker threads when there is more than one chunk.
+template<typename Work>
+static void parallelChunks(size_t count, size_t grain, Work work) {
+    const size_t chunks = (count + grain - 1) / grain;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, chunks));
+    if (threads <= 1) {
+        if (count > 0) work(size_t(0), count);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t c = next++; c < chunks; c = next++) {
+            work(c * grain, std::min(count, (c + 1) * grain));
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+static std::vector<std::shared_ptr<GeometricEntity>> pick(const std::vector<std::shared_ptr<GeometricEntity>>& entities,
+                                                          const std::vector<int>& ids) {
+    std::vector<std::shared_ptr<GeometricEntity>> result;
+    result.reserve(ids.size());
+    for (int id : ids) result.push_back(entities[id]);
+    return result;
+}
+
+static QRectF around(const QPointF& point, double radius) {
+    return QRectF(point.x() - radius, point.y() - radius, 2 * radius, 2 * radius);
+}
+
+std::shared_ptr<GeometricEntity> Sketch::entityAt(const QPointF& point, double tolerance) const {
+    // Later entities draw on top, so the highest index wins.
+    int best = -1;
+    m_index.query(around(point, tolerance), [&](int id) {
+        if (id > best && m_entities[id]->contains(point, tolerance)) best = id;
+    });
+    return best < 0 ? nullptr : m_entities[best];
+}
+
+std::vector<std::shared_ptr<GeometricEntity>> Sketch::entitiesAt(const QPointF& point, double tolerance) const {
+    std::vector<int> hits;
+    m_index.query(around(point, tolerance), [&](int id) {
+        if (m_entities[id]->contains(point, tolerance)) hits.push_back(id);
+    });
+    std::sort(hits.begin(), hits.end(), std::greater<int>());
+    return pick(m_entities, hits);
+}
+
+std::shared_ptr<GeometricEntity> Sketch::nearestEntity(const QPointF& point, double maxDistance) const {
+    int id = m_index.nearest(point, maxDistance, [&](int id) {
+        return m_entities[id]->distance(point);
+    });
+    return id == SpatialIndex::Null ? nullptr : m_entities[id];
+}
+
+std::vector<std::shared_ptr<GeometricEntity>> Sketch::nearestEntities(const std::vector<QPointF>& points, double maxDistance) const {
+    std::vector<int> ids(points.size(), SpatialIndex::Null);
+    parallelChunks(points.size(), NearestGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            ids[i] = m_index.nearest(points[i], maxDistance, [&](int id) {
+                return m_entities[id]->distance(points[i]);
+            });
+        }
+    });
+
+    std::vector<std::shared_ptr<GeometricEntity>> result(points.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (ids[i] != SpatialIndex::Null) result[i] = m_entities[ids[i]];
+    }
+    return result;
+}
+
+bool Sketch::scanBeatsIndex(const SpatialIndex::Box& region) const {
+    if (m_bounds.size() < ScanMinimum) return false;
+    const SpatialIndex::Box all = m_index.bounds();
+    const double allArea = (all.maxX - all.minX) * (all.maxY - all.minY);
+    const double covered = std::max(0.0, std::min(region.maxX, all.maxX) - std::max(region.minX, all.minX)) *
+                           std::max(0.0, std::min(region.maxY, all.maxY) - std::max(region.minY, all.minY));
+    return covered >= ScanCoverage * allArea;
+}
+
+template<typename Accept>
+std::vector<int> Sketch::entitiesInside(const QRectF& region, Accept accept) const {
+    const SpatialIndex::Box box(region);
+    std::vector<int> hits;
+
+    if (!scanBeatsIndex(box)) {
+        m_index.query(region, [&](int id) {
+            if (m_bounds.inside(id, box) && accept(id)) hits.push_back(id);
+        });
+        std::sort(hits.begin(), hits.end());
+        return hits;
+    }
+
+    const size_t count = m_bounds.size();
+    std::vector<uint8_t> mask(count);
+    parallelChunks(count, ScanGrain, [&](size_t begin, size_t end) {
+        m_bounds.inside(box, begin, end, mask.data());
+        for (size_t i = begin; i < end; ++i) {
+            if (mask[i] && !accept(static_cast<int>(i))) mask[i] = 0;
+        }
+    });
+    for (size_t i = 0; i < count; ++i) {
+        if (mask[i]) hits.push_back(static_cast<int>(i));
+    }
+    return hits;
+}
+
+std::vector<std::shared_ptr<GeometricEntity>> Sketch::entitiesIn(const QRectF& rect) const {
+    return pick(m_entities, entitiesInside(rect, [](int) { return true; }));
+}
+
+// True if segment ab meets the closed box, by clipping it to both slabs.
+static bool segmentMeetsBox(const QPointF& a, const QPointF& b, const SpatialIndex::Box& box) {
+    if (std::max(a.x(), b.x()) < box.minX || std::min(a.x(), b.x()) > box.maxX ||
+        std::max(a.y(), b.y()) < box.minY || std::min(a.y(), b.y()) > box.maxY) return false;
+    const double d[2] = {b.x() - a.x(), b.y() - a.y()};
+    const double lo[2] = {box.minX - a.x(), box.minY - a.y()};
+    const double hi[2] = {box.maxX - a.x(), box.maxY - a.y()};
+    double t0 = 0.0, t1 = 1.0;
+    for (int k = 0; k < 2; ++k) {
+        if (d[k] == 0.0) {
+            if (lo[k] > 0.0 || hi[k] < 0.0) return false;
+            continue;
+        }
+        double ta = lo[k] / d[k], tb = hi[k] / d[k];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// Chord error, relative to an entity's size, of the outline tested against
+// a lasso that crosses the entity's box.
+static constexpr double LassoFlatness = 1e-3;
+
+namespace {
+
+// Lasso edges bucketed into horizontal bands, so testing a small box only
+// looks at the few edges that pass its height.
+class LassoBands {
+public:
+    explicit LassoBands(const QPolygonF& lasso) : m_lasso(lasso), m_n(static_cast<int>(lasso.size())) {
+        m_minY = m_maxY = lasso[0].y();
+        for (const QPointF& p : lasso) {
+            m_minY = std::min(m_minY, p.y());
+            m_maxY = std::max(m_maxY, p.y());
+        }
+        const int count = std::min(m_n, 1024);
+        m_scale = m_maxY > m_minY ? count / (m_maxY - m_minY) : 0.0;
+        m_bands.resize(count);
+        for (int i = 0; i < m_n; ++i) {
+            const QPointF& a = m_lasso[i];
+            const QPointF& b = m_lasso[(i + 1) % m_n];
+            const int last = band(std::max(a.y(), b.y()));
+            for (int k = band(std::min(a.y(), b.y())); k <= last; ++k) m_bands[k].push_back(i);
+        }
+    }
+
+    enum class Relation { Outside, Inside, Crossed };
+
+    // A box no lasso edge meets lies wholly inside or wholly outside, so
+    // one corner decides, by counting edge crossings of a ray along +x.
+    Relation relation(const SpatialIndex::Box& box) const {
+        const int first = band(box.minY), last = band(box.maxY);
+        for (int k = first; k <= last; ++k) {
+            for (int i : m_bands[k]) {
+                if (segmentMeetsBox(m_lasso[i], m_lasso[(i + 1) % m_n], box)) return Relation::Crossed;
+            }
+        }
+        bool inside = false;
+        for (int i : m_bands[first]) {
+            const QPointF& a = m_lasso[i];
+            const QPointF& b = m_lasso[(i + 1) % m_n];
+            if ((a.y() > box.minY) == (b.y() > box.minY) || std::max(a.x(), b.x()) <= box.minX) continue;
+            if (std::min(a.x(), b.x()) > box.minX ||
+                box.minX < a.x() + (b.x() - a.x()) * (box.minY - a.y()) / (b.y() - a.y())) {
+                inside = !inside;
+            }
+        }
+        return inside ? Relation::Inside : Relation::Outside;
+    }
+
+    // A polyline lies inside when all its points do and none of its
+    // segments crosses a lasso edge on the way between them.
+    bool contains(const QPolygonF& polyline, bool closed) const {
+        const int n = static_cast<int>(polyline.size());
+        for (const QPointF& p : polyline) {
+            if (relation(SpatialIndex::Box(p.x(), p.y(), p.x(), p.y())) != Relation::Inside) return false;
+        }
+        const int segments = closed && n > 2 ? n : n - 1;
+        for (int j = 0; j < segments; ++j) {
+            const QPointF& a = polyline[j];
+            const QPointF& b = polyline[(j + 1) % n];
+            const int last = band(std::max(a.y(), b.y()));
+            for (int k = band(std::min(a.y(), b.y())); k <= last; ++k) {
+                for (int i : m_bands[k]) {
+                    if (segmentsCross(a, b, m_lasso[i], m_lasso[(i + 1) % m_n])) return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    static double turn(const QPointF& o, const QPointF& a, const QPointF& b) {
+        return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+    }
+
+    // Proper crossing of segments ab and cd; touching ends are left to the
+    // point test.
+    static bool segmentsCross(const QPointF& a, const QPointF& b, const QPointF& c, const QPointF& d) {
+        const double ca = turn(c, d, a), cb = turn(c, d, b);
+        const double ac = turn(a, b, c), ad = turn(a, b, d);
+        return ((ca > 0.0 && cb < 0.0) || (ca < 0.0 && cb > 0.0)) &&
+               ((ac > 0.0 && ad < 0.0) || (ac < 0.0 && ad > 0.0));
+    }
+
+    int band(double y) const {
+        double k = (y - m_minY) * m_scale;
+        return static_cast<int>(std::max(0.0, std::min(k, static_cast<double>(m_bands.size() - 1))));
+    }
+
+    const QPolygonF& m_lasso;
+    int m_n;
+    double m_minY, m_maxY, m_scale;
+    std::vector<std::vector<int>> m_bands;
+};
+
+} // namespace
+
+std::vector<std::shared_ptr<GeometricEntity>> Sketch::entitiesInLasso(const QPolygonF& lasso) const {
+    if (lasso.size() < 3) return {};
+    const LassoBands bands(lasso);
+    return pick(m_entities, entitiesInside(lasso.boundingRect(), [&](int id) {
+        // The box decides unless the lasso crosses it; then the entity's
+        // own shape does, flattened finely relative to its size.
+        const SpatialIndex::Box box = m_bounds.box(id);
+        switch (bands.relation(box)) {
+            case LassoBands::Relation::Inside: return true;
+            case LassoBands::Relation::Outside: return false;
+            case LassoBands::Relation::Crossed: break;
+        }
+        thread_local QPolygonF shape;
+        shape.clear();
+        const double extent = std::max(box.maxX - box.minX, box.maxY - box.minY);
+        const bool closed = m_entities[id]->shape(shape, std::max(extent * LassoFlatness, 1e-9));
+        return !shape.isEmpty() && bands.contains(shape, closed);
+    }));
+}
+
+int Sketch::degreesOfFreedom(const std::shared_ptr<GeometricEntity>& entity) const {
+    if (!entity || !m_solverValid) return -1;
+    // Solves skip the rank analysis so dragging only pays for the solve;
+    // the diagnosis queries run it on demand.
+    m_solver.analyze();
+    return m_solver.freedom(entity->getParameters());
+}
+
+std::vector<std::shared_ptr<Constraint>> Sketch::redundantConstraints() const {
+    std::vector<std::shared_ptr<Constraint>> result;
+    m_solver.analyze();
+    for (int i : m_solver.redundantConstraints()) result.push_back(m_constraints[i]);
+    return result;
+}
+
+std::vector<std::shared_ptr<Constraint>> Sketch::conflictingConstraints() const {
+    std::vector<std::shared_ptr<Constraint>> result;
+    m_solver.analyze();
+    for (int i : m_solver.conflictingConstraints()) result.push_back(m_constraints[i]);
+    return result;
+}
@@ -3,23 +3,152 @@
 
 #include <vector>
 #include <memory>
+#include <unordered_map>
 #include <QPainter> 
+#include <QPolygonF>
 #include "GeometricEntity.h"
+#include "ParameterStore.h"
+#include "SpatialIndex.h"
+#include "BoundsArray.h"
+#include "DrawBatch.h"
+#include "EntityArena.h"
+#include "../ConstraintSolver/Solver.h"
 
 class Sketch {
 private:
+    // Pools the entities made through create() by type; an allocator only.
+    EntityArena m_arena;
+
     std::vector<std::shared_ptr<GeometricEntity>> m_entities;
+    std::vector<std::shared_ptr<Constraint>> m_constraints;
+
+    // Every entity's parameters, packed so the solver walks memory linearly.
+    ParameterStore m_parameters;
+
+    // Kept across calls so interactive edits re-solve incrementally. The
+    // const diagnosis queries run its rank analysis lazily.
+    mutable Solver m_solver;
+    bool m_solverValid = false;
+
+    // Entity bounds for hit-testing and region queries; ids are indices
+    // into m_entities, m_proxies holds each entity's leaf.
+    SpatialIndex m_index;
+    std::vector<int> m_proxies;
+    size_t m_indexRebuiltAt = 0; // entity count at the last full rebuild
+
+    // The same exact bounds by coordinate, scanned instead of the tree when
+    // a region query covers much of the sketch.
+    BoundsArray m_bounds;
+
+    // How far any entity has drawn outside its bounds so far, so culling
+    // queries widen the view by it. Only ever grows.
+    double m_drawMargin = 0.0;
+
+    // Which entities each parameter belongs to, and the entities changed
+    // since the index was last refreshed.
+    std::unordered_multimap<const double*, int> m_dependents;
+    std::unordered_map<const GeometricEntity*, int> m_entityIndex;
+    std::vector<int> m_changed;
+    std::vector<char> m_isChanged;
+
+    void rebuildSolver();
+    void markChanged(int entity);
+    void parameterWritten(const double* param);
+    void refreshIndex();
+
+    void boundsChanged(int entity, const QRectF& bounds);
+
+    // True when region covers enough of a large sketch that scanning all
+    // bounds in order beats walking the tree.
+    bool scanBeatsIndex(const SpatialIndex::Box& region) const;
+
+    // Calls visit(id, extent) in drawing order for each entity that can
+    // reach into visible, with its size in pixels at scale when lod
+    // simplifies, else infinity.
+    template<typename Visit>
+    void forEachDrawn(const QRectF& visible, double scale, const LevelOfDetail& lod, Visit visit) const;
+
+    // Entities whose bounds lie inside region and that pass accept(id), in
+    // drawing order. accept may run on several threads at once.
+    template<typename Accept>
+    std::vector<int> entitiesInside(const QRectF& region, Accept accept) const;
 
 public:
     Sketch();
     ~Sketch();
 
+    // Constructs an entity in the sketch's arena, next to others of its
+    // type, without adding it; pass it to addEntity() as usual. The pointer
+    // owns the entity like make_shared's would.
+    template<typename T, typename... Args>
+    std::shared_ptr<T> create(Args&&... args) {
+        return m_arena.create<T>(std::forward<Args>(args)...);
+    }
+    EntityArena& arena() { return m_arena; }
+    const EntityArena& arena() const { return m_arena; }
+
     void addEntity(std::shared_ptr<GeometricEntity> entity);
+    void addConstraint(std::shared_ptr<Constraint> constraint);
     
     void draw(QPainter& painter) const;
 
+    // Draws only the entities that can reach into visible, a world rect
+    // such as the widget's area mapped back through the view, in order,
+    // simplified on screen as lod allows.
+    void draw(QPainter& painter, const QRectF& visible, const LevelOfDetail& lod = LevelOfDetail()) const;
+
+    // Builds the draw caches of what draw() would draw through a view of
+    // scale pixels per unit. Afterwards, until anything changes, several
+    // threads may draw the sketch at once, each with its own painter.
+    void prepareDraw(const QRectF& visible, double scale, const LevelOfDetail& lod = LevelOfDetail()) const;
+
     const std::vector<std::shared_ptr<GeometricEntity>>& getEntities() const;
-    void update();
+    const std::vector<std::shared_ptr<Constraint>>& getConstraints() const;
+    const ParameterStore& parameters() const { return m_parameters; }
+
+    Solver::Status update();
+
+    // Call after writing to one of an entity's parameters. Re-solves only the
+    // affected cluster, keeping the edited value where possible.
+    Solver::Status parameterChanged(double* param);
+
+    // Call after changing an entity other than through its parameters, such
+    // as its thickness or selection, so its bounds and index entry follow.
+    void entityChanged(const std::shared_ptr<GeometricEntity>& entity);
+
+    // Metrics of the most recent update() or parameterChanged().
+    const Solver::Report& solveReport() const { return m_solver.report(); }
+
+    // Motions the constraints still leave to an entity after the last solve,
+    // e.g. 2 for a free point, 0 once fully constrained; -1 if unknown.
+    // These run the rank analysis the solves skip, once per solve, so call
+    // them when an edit is over rather than on every drag step.
+    int degreesOfFreedom(const std::shared_ptr<GeometricEntity>& entity) const;
+
+    // Constraints the last solve found to depend on others: redundant ones
+    // are satisfied anyway, conflicting ones cannot be.
+    std::vector<std::shared_ptr<Constraint>> redundantConstraints() const;
+    std::vector<std::shared_ptr<Constraint>> conflictingConstraints() const;
+
+    // Topmost entity whose outline passes within tolerance of point, or null.
+    std::shared_ptr<GeometricEntity> entityAt(const QPointF& point, double tolerance) const;
+
+    // Every entity within tolerance of point, topmost first.
+    std::vector<std::shared_ptr<GeometricEntity>> entitiesAt(const QPointF& point, double tolerance) const;
+
+    // Entity whose outline is closest to point, or null if none is within
+    // maxDistance.
+    std::shared_ptr<GeometricEntity> nearestEntity(const QPointF& point, double maxDistance) const;
+
+    // nearestEntity() for each of many points, such as snap candidates;
+    // null where nothing is within maxDistance. Large batches run on
+    // worker threads.
+    std::vector<std::shared_ptr<GeometricEntity>> nearestEntities(const std::vector<QPointF>& points, double maxDistance) const;
+
+    // Entities lying entirely inside a rectangle or lasso, in drawing order.
+    // Regions covering much of a large sketch are scanned in parallel.
+    std::vector<std::shared_ptr<GeometricEntity>> entitiesIn(const QRectF& rect) const;
+    std::vector<std::shared_ptr<GeometricEntity>> entitiesInLasso(const QPolygonF& lasso) const;
 };
 
-#endif
\ No newline at end of file
+#endif
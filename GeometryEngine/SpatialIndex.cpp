@@ -0,0 +1,256 @@
+#include "SpatialIndex.h"
+#include <cassert>
+
+int SpatialIndex::allocateNode() {
+    if (m_free == Null) {
+        m_nodes.emplace_back();
+        return static_cast<int>(m_nodes.size()) - 1;
+    }
+    int index = m_free;
+    m_free = m_nodes[index].parent;
+    m_nodes[index] = Node();
+    return index;
+}
+
+void SpatialIndex::freeNode(int index) {
+    m_nodes[index].parent = m_free;
+    m_nodes[index].height = -1;
+    m_free = index;
+}
+
+SpatialIndex::Box SpatialIndex::enlarged(const Box& box) const {
+    double m = m_margin * std::max(box.maxX - box.minX, box.maxY - box.minY);
+    return Box(box.minX - m, box.minY - m, box.maxX + m, box.maxY + m);
+}
+
+int SpatialIndex::insert(const QRectF& bounds, int id) {
+    int leaf = allocateNode();
+    m_nodes[leaf].box = enlarged(Box(bounds));
+    m_nodes[leaf].id = id;
+    insertLeaf(leaf);
+    ++m_leafCount;
+    return leaf;
+}
+
+void SpatialIndex::remove(int proxy) {
+    assert(proxy >= 0 && m_nodes[proxy].isLeaf());
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --m_leafCount;
+}
+
+bool SpatialIndex::update(int proxy, const QRectF& bounds) {
+    Box box(bounds);
+    Box& current = m_nodes[proxy].box;
+    if (current.contains(box)) {
+        // Still inside; only move it if it has shrunk well below the
+        // enlarged box, which would otherwise make queries return it too
+        // often.
+        Box fat = enlarged(box);
+        if (current.perimeter() <= 2.0 * fat.perimeter()) return false;
+    }
+    removeLeaf(proxy);
+    m_nodes[proxy].box = enlarged(box);
+    insertLeaf(proxy);
+    return true;
+}
+
+void SpatialIndex::rebuild() {
+    if (m_root == Null) return;
+
+    std::vector<int> leaves;
+    leaves.reserve(m_leafCount);
+    for (int i = 0; i < static_cast<int>(m_nodes.size()); ++i) {
+        if (m_nodes[i].height == 0) leaves.push_back(i);
+    }
+
+    // Free every inner node, highest index first so the build below takes
+    // them back in ascending order.
+    m_free = Null;
+    for (int i = static_cast<int>(m_nodes.size()) - 1; i >= 0; --i) {
+        if (m_nodes[i].height != 0) freeNode(i);
+    }
+
+    m_root = build(leaves.data(), static_cast<int>(leaves.size()));
+    m_nodes[m_root].parent = Null;
+}
+
+int SpatialIndex::build(int* leaves, int count) {
+    if (count == 1) return leaves[0];
+
+    Box bounds = m_nodes[leaves[0]].box;
+    for (int i = 1; i < count; ++i) bounds = Box::merged(bounds, m_nodes[leaves[i]].box);
+
+    // Split at the median centre along the longer side.
+    const bool alongX = bounds.maxX - bounds.minX >= bounds.maxY - bounds.minY;
+    auto centre = [&](int leaf) {
+        const Box& b = m_nodes[leaf].box;
+        return alongX ? b.minX + b.maxX : b.minY + b.maxY;
+    };
+    int half = count / 2;
+    std::nth_element(leaves, leaves + half, leaves + count,
+                     [&](int a, int b) { return centre(a) < centre(b); });
+
+    int index = allocateNode();
+    int child1 = build(leaves, half);
+    int child2 = build(leaves + half, count - half);
+
+    Node& node = m_nodes[index];
+    node.child1 = child1;
+    node.child2 = child2;
+    node.box = bounds;
+    node.height = 1 + std::max(m_nodes[child1].height, m_nodes[child2].height);
+    m_nodes[child1].parent = index;
+    m_nodes[child2].parent = index;
+    return index;
+}
+
+void SpatialIndex::clear() {
+    m_nodes.clear();
+    m_root = Null;
+    m_free = Null;
+    m_leafCount = 0;
+}
+
+void SpatialIndex::insertLeaf(int leaf) {
+    if (m_root == Null) {
+        m_root = leaf;
+        m_nodes[leaf].parent = Null;
+        return;
+    }
+
+    // Descend towards the sibling whose box grows least, comparing the cost
+    // of pairing with this node against pushing the leaf further down.
+    const Box leafBox = m_nodes[leaf].box;
+    int index = m_root;
+    while (!m_nodes[index].isLeaf()) {
+        const Node& node = m_nodes[index];
+        double perimeter = node.box.perimeter();
+        double combined = Box::merged(node.box, leafBox).perimeter();
+
+        double cost = 2.0 * combined;
+        double inherited = 2.0 * (combined - perimeter);
+
+        auto descendCost = [&](int child) {
+            const Node& c = m_nodes[child];
+            double grown = Box::merged(c.box, leafBox).perimeter();
+            return c.isLeaf() ? grown + inherited : grown - c.box.perimeter() + inherited;
+        };
+        double cost1 = descendCost(node.child1);
+        double cost2 = descendCost(node.child2);
+
+        if (cost < cost1 && cost < cost2) break;
+        index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+
+    int sibling = index;
+    int oldParent = m_nodes[sibling].parent;
+    int newParent = allocateNode();
+    m_nodes[newParent].parent = oldParent;
+    m_nodes[newParent].box = Box::merged(leafBox, m_nodes[sibling].box);
+    m_nodes[newParent].height = m_nodes[sibling].height + 1;
+    m_nodes[newParent].child1 = sibling;
+    m_nodes[newParent].child2 = leaf;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if (oldParent == Null) {
+        m_root = newParent;
+    } else if (m_nodes[oldParent].child1 == sibling) {
+        m_nodes[oldParent].child1 = newParent;
+    } else {
+        m_nodes[oldParent].child2 = newParent;
+    }
+
+    refit(newParent);
+}
+
+void SpatialIndex::removeLeaf(int leaf) {
+    if (leaf == m_root) {
+        m_root = Null;
+        return;
+    }
+
+    int parent = m_nodes[leaf].parent;
+    int grandParent = m_nodes[parent].parent;
+    int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+    if (grandParent == Null) {
+        m_root = sibling;
+        m_nodes[sibling].parent = Null;
+        freeNode(parent);
+        return;
+    }
+
+    if (m_nodes[grandParent].child1 == parent) {
+        m_nodes[grandParent].child1 = sibling;
+    } else {
+        m_nodes[grandParent].child2 = sibling;
+    }
+    m_nodes[sibling].parent = grandParent;
+    freeNode(parent);
+    refit(grandParent);
+}
+
+// Walks from index to the root, rebalancing and recomputing boxes.
+void SpatialIndex::refit(int index) {
+    while (index != Null) {
+        index = balance(index);
+        Node& node = m_nodes[index];
+        const Node& a = m_nodes[node.child1];
+        const Node& b = m_nodes[node.child2];
+        node.height = 1 + std::max(a.height, b.height);
+        node.box = Box::merged(a.box, b.box);
+        index = node.parent;
+    }
+}
+
+// Rotates the taller grandchild up when index's subtrees differ in height by
+// more than one. Returns the node now in index's place.
+int SpatialIndex::balance(int iA) {
+    Node& A = m_nodes[iA];
+    if (A.isLeaf() || A.height < 2) return iA;
+
+    int iB = A.child1;
+    int iC = A.child2;
+    int difference = m_nodes[iC].height - m_nodes[iB].height;
+    if (difference >= -1 && difference <= 1) return iA;
+
+    // Lift the taller child (up) over A; A takes the shorter of up's
+    // children in its place.
+    const bool liftC = difference > 1;
+    int iUp = liftC ? iC : iB;
+    int iStay = liftC ? iB : iC;
+    Node& Up = m_nodes[iUp];
+    int iF = Up.child1;
+    int iG = Up.child2;
+    Node& F = m_nodes[iF];
+    Node& G = m_nodes[iG];
+
+    Up.child1 = iA;
+    Up.parent = A.parent;
+    A.parent = iUp;
+
+    if (Up.parent == Null) {
+        m_root = iUp;
+    } else if (m_nodes[Up.parent].child1 == iA) {
+        m_nodes[Up.parent].child1 = iUp;
+    } else {
+        m_nodes[Up.parent].child2 = iUp;
+    }
+
+    // Up keeps its taller child; the other moves under A.
+    int iKeep = F.height > G.height ? iF : iG;
+    int iMove = F.height > G.height ? iG : iF;
+    Up.child2 = iKeep;
+    if (liftC) A.child2 = iMove; else A.child1 = iMove;
+    m_nodes[iMove].parent = iA;
+
+    const Node& stay = m_nodes[iStay];
+    const Node& moved = m_nodes[iMove];
+    A.box = Box::merged(stay.box, moved.box);
+    A.height = 1 + std::max(stay.height, moved.height);
+    Up.box = Box::merged(A.box, m_nodes[iKeep].box);
+    Up.height = 1 + std::max(A.height, m_nodes[iKeep].height);
+    return iUp;
+}
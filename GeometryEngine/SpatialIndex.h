@@ -0,0 +1,162 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QPointF>
+#include <QRectF>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Dynamic bounding-volume tree over entity boxes. Leaves keep their box
+// enlarged by a margin, so the small moves of an interactive edit usually
+// leave the tree untouched; the tree is rebalanced by rotations on insert.
+class SpatialIndex {
+public:
+    static constexpr int Null = -1;
+
+    // Axis-aligned box. Unlike QRectF it stays valid when flat, as for
+    // horizontal lines.
+    struct Box {
+        double minX = 0.0, minY = 0.0, maxX = 0.0, maxY = 0.0;
+
+        Box() = default;
+        Box(double x0, double y0, double x1, double y1) : minX(x0), minY(y0), maxX(x1), maxY(y1) {}
+        explicit Box(const QRectF& r) {
+            QRectF n = r.normalized();
+            minX = n.left(); minY = n.top(); maxX = n.right(); maxY = n.bottom();
+        }
+
+        QRectF toRect() const { return QRectF(QPointF(minX, minY), QPointF(maxX, maxY)); }
+
+        bool overlaps(const Box& o) const {
+            return minX <= o.maxX && o.minX <= maxX && minY <= o.maxY && o.minY <= maxY;
+        }
+        bool contains(const Box& o) const {
+            return minX <= o.minX && minY <= o.minY && o.maxX <= maxX && o.maxY <= maxY;
+        }
+        double perimeter() const { return 2.0 * ((maxX - minX) + (maxY - minY)); }
+
+        double distanceTo(const QPointF& p) const {
+            double dx = std::max({minX - p.x(), 0.0, p.x() - maxX});
+            double dy = std::max({minY - p.y(), 0.0, p.y() - maxY});
+            return std::sqrt(dx * dx + dy * dy);
+        }
+
+        static Box merged(const Box& a, const Box& b) {
+            return Box(std::min(a.minX, b.minX), std::min(a.minY, b.minY),
+                       std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY));
+        }
+    };
+
+    // margin is the fraction of a box's larger side it may drift before
+    // its leaf is moved.
+    explicit SpatialIndex(double margin = 0.1) : m_margin(margin) {}
+
+    // Returns a proxy handle for update() and remove(); id is what queries
+    // report back.
+    int insert(const QRectF& bounds, int id);
+    void remove(int proxy);
+
+    // Returns true if the leaf had to be moved.
+    bool update(int proxy, const QRectF& bounds);
+
+    // Rebuilds the inner nodes top-down by median splits. Incremental
+    // inserts give a looser tree; this tightens it and lays the inner nodes
+    // out depth-first. Proxies stay valid.
+    void rebuild();
+
+    void clear();
+    size_t size() const { return m_leafCount; }
+    int height() const { return m_root == Null ? 0 : m_nodes[m_root].height; }
+
+    // Box around every leaf's enlarged box; empty when the index is.
+    Box bounds() const { return m_root == Null ? Box() : m_nodes[m_root].box; }
+
+    // Calls visit(id) for every leaf whose box overlaps the region. Leaf
+    // boxes are enlarged, so callers still test the exact geometry.
+    template<typename Visit>
+    void query(const QRectF& region, Visit&& visit) const {
+        if (m_root == Null) return;
+        Box box(region);
+        // Local so concurrent const queries are safe.
+        std::vector<int> stack;
+        stack.reserve(64);
+        stack.push_back(m_root);
+        while (!stack.empty()) {
+            const Node& node = m_nodes[stack.back()];
+            stack.pop_back();
+            if (!node.box.overlaps(box)) continue;
+            if (node.isLeaf()) {
+                visit(node.id);
+            } else {
+                stack.push_back(node.child1);
+                stack.push_back(node.child2);
+            }
+        }
+    }
+
+    // Best-first search for the id with the smallest distance(id) that is at
+    // most maxDistance; Null if none. distance(id) must never be less than
+    // the distance to that id's bounds.
+    template<typename Distance>
+    int nearest(const QPointF& point, double maxDistance, Distance&& distance) const {
+        if (m_root == Null) return Null;
+        using Entry = std::pair<double, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+        open.emplace(m_nodes[m_root].box.distanceTo(point), m_root);
+
+        int best = Null;
+        double bestDistance = maxDistance;
+        while (!open.empty()) {
+            auto [bound, index] = open.top();
+            open.pop();
+            if (bound > bestDistance) break;
+            const Node& node = m_nodes[index];
+            if (node.isLeaf()) {
+                double d = distance(node.id);
+                if (d <= bestDistance) {
+                    bestDistance = d;
+                    best = node.id;
+                }
+                continue;
+            }
+            for (int child : {node.child1, node.child2}) {
+                double d = m_nodes[child].box.distanceTo(point);
+                if (d <= bestDistance) open.emplace(d, child);
+            }
+        }
+        return best;
+    }
+
+private:
+    struct Node {
+        Box box;
+        int parent = Null; // next free node while on the free list
+        int child1 = Null;
+        int child2 = Null;
+        int id = Null;
+        int height = 0; // 0 for leaves, -1 for free nodes
+
+        bool isLeaf() const { return child1 == Null; }
+    };
+
+    int allocateNode();
+    void freeNode(int index);
+    Box enlarged(const Box& box) const;
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int balance(int index);
+    int build(int* leaves, int count);
+
+    std::vector<Node> m_nodes;
+    int m_root = Null;
+    int m_free = Null;
+    size_t m_leafCount = 0;
+    double m_margin;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef TESSELLATION_H
+#define TESSELLATION_H
+
+#include <QPainter>
+#include <QPointF>
+#include <QPolygonF>
+#include <QTransform>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Flattening of curved outlines into polylines with a bounded chord error.
+namespace Tessellation {
+
+// Chord error allowed when drawing, in device pixels.
+constexpr double DrawFlatness = 0.25;
+
+// Hit tests flatten to this fraction of their tolerance. With the canvas's
+// 5 px pick radius that is the drawing level, so both share one polyline.
+constexpr double HitFlatness = 0.05;
+
+// Device pixels per world unit through a view transform or a painter's.
+inline double pixelScale(const QTransform& t) {
+    return std::sqrt(std::abs(t.m11() * t.m22() - t.m12() * t.m21()));
+}
+inline double pixelScale(const QPainter& painter) {
+    return pixelScale(painter.worldTransform());
+}
+
+// World-space chord error for drawing through the painter's transform.
+inline double drawTolerance(const QPainter& painter, double flatness = DrawFlatness) {
+    double scale = pixelScale(painter);
+    return scale > 0.0 ? flatness / scale : flatness;
+}
+
+// Ellipse sampled at equal parameter steps, closed implicitly. The chord
+// error is that of the circle of the larger radius, which bounds it.
+inline void ellipse(QPolygonF& out, const QPointF& center, double rx, double ry, double tolerance) {
+    double r = std::max(std::abs(rx), std::abs(ry));
+    int segments = 8;
+    if (r > tolerance) {
+        double step = 2.0 * std::acos(1.0 - tolerance / r);
+        segments = std::max(segments, static_cast<int>(std::ceil(2.0 * M_PI / step)));
+    }
+    segments = std::min(segments, 1 << 16);
+
+    out.reserve(segments);
+    for (int i = 0; i < segments; ++i) {
+        double angle = 2.0 * M_PI * i / segments;
+        out << QPointF(center.x() + rx * std::cos(angle), center.y() + ry * std::sin(angle));
+    }
+}
+
+namespace detail {
+
+// Largest distance of the inner control points from the chord segment; the
+// curve lies in their hull, so this bounds the error of drawing the chord.
+inline double flatness(const QPointF* p, int count) {
+    const double ux = p[count - 1].x() - p[0].x(), uy = p[count - 1].y() - p[0].y();
+    const double l2 = ux * ux + uy * uy;
+    double worst = 0.0;
+    for (int i = 1; i < count - 1; ++i) {
+        double wx = p[i].x() - p[0].x(), wy = p[i].y() - p[0].y();
+        double t = l2 > 0.0 ? std::max(0.0, std::min(1.0, (wx * ux + wy * uy) / l2)) : 0.0;
+        double ex = wx - t * ux, ey = wy - t * uy;
+        worst = std::max(worst, ex * ex + ey * ey);
+    }
+    return std::sqrt(worst);
+}
+
+inline void subdivide(QPolygonF& out, std::vector<QPointF>& scratch, std::vector<QPointF>& row,
+                      size_t at, int count, double tolerance, int depth) {
+    if (depth == 0 || flatness(scratch.data() + at, count) <= tolerance) {
+        out << scratch[at + count - 1];
+        return;
+    }
+
+    // de Casteljau at t = 1/2: the left half is the first point of each
+    // row of the triangle, the right half the last, read bottom-up.
+    std::copy(scratch.begin() + at, scratch.begin() + at + count, row.begin());
+    size_t left = scratch.size();
+    scratch.resize(left + 2 * count);
+    for (int level = 0; level < count; ++level) {
+        scratch[left + level] = row[0];
+        scratch[left + 2 * count - 1 - level] = row[count - 1 - level];
+        for (int i = 0; i + 1 < count - level; ++i) row[i] = 0.5 * (row[i] + row[i + 1]);
+    }
+    subdivide(out, scratch, row, left, count, tolerance, depth - 1);
+    subdivide(out, scratch, row, left + count, count, tolerance, depth - 1);
+    scratch.resize(left);
+}
+
+} // namespace detail
+
+// Bezier curve of any degree by adaptive de Casteljau subdivision.
+inline void bezier(QPolygonF& out, const QPointF* controlPoints, int count, double tolerance) {
+    if (count < 1) return;
+    out << controlPoints[0];
+    if (count < 2) return;
+    const int maxDepth = 16;
+    std::vector<QPointF> scratch(controlPoints, controlPoints + count);
+    scratch.reserve(count * (2 * maxDepth + 1));
+    std::vector<QPointF> row(count);
+    detail::subdivide(out, scratch, row, 0, count, tolerance, maxDepth);
+}
+
+// Distance from point to a polyline, closing it back to the start if asked.
+inline double distance(const QPolygonF& polyline, const QPointF& point, bool closed) {
+    const int n = static_cast<int>(polyline.size());
+    if (n == 0) return std::numeric_limits<double>::infinity();
+    if (n == 1) return std::hypot(point.x() - polyline[0].x(), point.y() - polyline[0].y());
+
+    double best = std::numeric_limits<double>::infinity();
+    const int segments = closed ? n : n - 1;
+    for (int i = 0; i < segments; ++i) {
+        const QPointF& a = polyline[i];
+        const QPointF& b = polyline[(i + 1) % n];
+        double ux = b.x() - a.x(), uy = b.y() - a.y();
+        double wx = point.x() - a.x(), wy = point.y() - a.y();
+        double l2 = ux * ux + uy * uy;
+        double t = l2 > 0.0 ? std::max(0.0, std::min(1.0, (wx * ux + wy * uy) / l2)) : 0.0;
+        double ex = wx - t * ux, ey = wy - t * uy;
+        best = std::min(best, ex * ex + ey * ey);
+    }
+    return std::sqrt(best);
+}
+
+} // namespace Tessellation
+
+// An entity's flattened outline, rebuilt only when its geometryVersion() or
+// the requested tolerance's power-of-two bucket changes. Two levels are kept so
+// drawing and a differently-sized query do not evict each other. Hits
+// write nothing but the atomic use clock, so once a level is built several
+// threads may fetch it at once.
+class TessellationCache {
+public:
+    // build(QPolygonF& out, double tolerance) appends the flattened outline.
+    template<typename Build>
+    const QPolygonF& get(uint64_t version, double tolerance, Build&& build) const {
+        tolerance = std::max(tolerance, std::numeric_limits<double>::min());
+        tolerance = std::min(tolerance, std::numeric_limits<double>::max());
+        const int bucket = std::ilogb(tolerance);
+
+        for (Level& level : m_levels) {
+            if (level.version == version && level.bucket == bucket) {
+                touch(level);
+                return level.points;
+            }
+        }
+
+        Level& level = m_levels[0].lastUse.load(std::memory_order_relaxed) <=
+                       m_levels[1].lastUse.load(std::memory_order_relaxed) ? m_levels[0] : m_levels[1];
+        level.points.clear();
+        build(level.points, std::ldexp(1.0, bucket));
+        level.version = version;
+        level.bucket = bucket;
+        touch(level);
+        return level.points;
+    }
+
+private:
+    struct Level {
+        QPolygonF points;
+        uint64_t version = std::numeric_limits<uint64_t>::max();
+        int bucket = INT_MIN;
+        std::atomic<uint64_t> lastUse{0};
+    };
+
+    void touch(Level& level) const {
+        level.lastUse.store(m_clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    mutable Level m_levels[2];
+    mutable std::atomic<uint64_t> m_clock{0};
+};
+
+#endif
@@ -141,17 +141,17 @@ std::shared_ptr<Sketch> DatabaseManager::loadSketch(const QString& name) {
         double y1 = query.value(2).toDouble();
         
         if (type == "POINT") {
-            sketch->addEntity(std::make_shared<Point>(x1, y1));
+            sketch->addEntity(sketch->create<Point>(x1, y1));
         } else if (type == "LINE") {
             double x2 = query.value(3).toDouble();
             double y2 = query.value(4).toDouble();
-            auto start = std::make_shared<Point>(x1, y1);
-            auto end = std::make_shared<Point>(x2, y2);
-            sketch->addEntity(std::make_shared<Line>(start, end));
+            auto start = sketch->create<Point>(x1, y1);
+            auto end = sketch->create<Point>(x2, y2);
+            sketch->addEntity(sketch->create<Line>(start, end));
         } else if (type == "CIRCLE") {
             double radius = query.value(5).toDouble();
-            auto center = std::make_shared<Point>(x1, y1);
-            sketch->addEntity(std::make_shared<Circle>(center, radius));
+            auto center = sketch->create<Point>(x1, y1);
+            sketch->addEntity(sketch->create<Circle>(center, radius));
         }
     }
 
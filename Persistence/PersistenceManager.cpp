@@ -31,12 +31,10 @@ std::shared_ptr<Sketch> PersistenceManager::loadSketch(const QString& filePath)
     auto sketch = std::make_shared<Sketch>();
     for (int i = 0; i < entities.size(); ++i) {
         QJsonObject obj = entities[i].toObject();
-        QString type = obj["type"].toString();
-        
-        std::shared_ptr<GeometricEntity> entity = GeometricEntityFactory::createEntity(type.toStdString());
+        std::shared_ptr<GeometricEntity> entity = GeometricEntityFactory::createEntity(obj, &sketch->arena());
 
         if (entity) {
-            entity->fromJson(obj);
+            entity->fromJson(obj, &sketch->arena());
             sketch->addEntity(entity);
         }
     }
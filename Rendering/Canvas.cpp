@@ -19,6 +19,7 @@ Canvas::~Canvas() {}
 
 void Canvas::setSketch(std::shared_ptr<Sketch> sketch) {
     m_sketch = sketch;
+    m_renderer.invalidate();
 }
 
 void Canvas::setDrawingMode(Mode mode) {
@@ -39,7 +40,9 @@ void Canvas::setDrawingMode(Mode mode) {
     // Deselect all when changing mode
     if (m_sketch) {
         for (auto& entity : m_sketch->getEntities()) {
+            if (!entity->isSelected()) continue;
             entity->setSelected(false);
+            m_sketch->entityChanged(entity);
         }
     }
     update();
@@ -50,13 +53,23 @@ void Canvas::toggleGrid() {
     update();
 }
 
+void Canvas::setLevelOfDetail(const LevelOfDetail& lod) {
+    m_renderer.setLevelOfDetail(lod);
+    update();
+}
+
+void Canvas::setTiledRendering(bool tiled) {
+    m_renderer.setTiled(tiled);
+    update();
+}
+
 QPointF Canvas::mapToWorld(const QPointF& screenPos) const {
     return (screenPos - m_offset) / m_scale;
 }
 
 void Canvas::addPoint(const QPointF& pos) {
     if (!m_sketch) return;
-    auto point = std::make_shared<Point>(pos.x(), pos.y());
+    auto point = m_sketch->create<Point>(pos.x(), pos.y());
     m_sketch->addEntity(point);
     update();
 }
@@ -111,15 +124,19 @@ void Canvas::paintEvent(QPaintEvent* event) {
     painter.setRenderHint(QPainter::Antialiasing);
     painter.fillRect(rect(), Qt::white);
 
-    painter.translate(m_offset);
-    painter.scale(m_scale, m_scale);
+    QTransform view;
+    view.translate(m_offset.x(), m_offset.y());
+    view.scale(m_scale, m_scale);
+    painter.setTransform(view);
 
     if (m_showGrid) {
         drawGrid(painter);
     }
 
     if (m_sketch) {
-        m_sketch->draw(painter);
+        painter.resetTransform();
+        m_renderer.paint(painter, *m_sketch, view, size(), devicePixelRatioF());
+        painter.setTransform(view);
     }
 
     if (m_state) {
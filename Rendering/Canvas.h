@@ -8,6 +8,7 @@
 #include <QCursor>
 #include <memory>
 #include "../GeometryEngine/Sketch.h"
+#include "SketchRenderer.h"
 
 class CanvasState;
 
@@ -35,6 +36,14 @@ public:
     Mode drawingMode() const { return m_mode; }
 
     void toggleGrid();
+
+    // Simplifications used when zoomed out over dense sketches.
+    void setLevelOfDetail(const LevelOfDetail& lod);
+    const LevelOfDetail& levelOfDetail() const { return m_renderer.levelOfDetail(); }
+
+    // Renders the sketch in cached tiles spread over worker threads.
+    void setTiledRendering(bool tiled);
+    bool tiledRendering() const { return m_renderer.isTiled(); }
     double scale() const { return m_scale; }
     
     QPointF mapToWorld(const QPointF& screenPos) const;
@@ -57,6 +66,9 @@ private:
     std::shared_ptr<Sketch> m_sketch;
     std::unique_ptr<CanvasState> m_state;
 
+    // Committed geometry, cached so previews only composite over it.
+    SketchRenderer m_renderer;
+
     double m_scale;
     QPointF m_offset;
     QPoint m_lastMousePos;
@@ -12,21 +12,20 @@ void SelectState::handleMousePress(QMouseEvent* event) {
     if (!m_canvas->sketch()) return;
 
     QPointF worldPos = m_canvas->mapToWorld(event->pos());
-    bool found = false;
     double tolerance = 5.0 / m_canvas->scale();
     const auto& entities = m_canvas->sketch()->getEntities();
-    
-    for (auto it = entities.rbegin(); it != entities.rend(); ++it) {
-        if ((*it)->contains(worldPos, tolerance)) {
-            bool currentState = (*it)->isSelected();
-            for (auto& e : entities) e->setSelected(false);
-            (*it)->setSelected(!currentState);
-            found = true;
-            break;
+
+    auto hit = m_canvas->sketch()->entityAt(worldPos, tolerance);
+    bool currentState = hit && hit->isSelected();
+    for (auto& e : entities) {
+        if (e->isSelected() && e != hit) {
+            e->setSelected(false);
+            m_canvas->sketch()->entityChanged(e);
         }
     }
-    if (!found) {
-        for (auto& e : entities) e->setSelected(false);
+    if (hit) {
+        hit->setSelected(!currentState);
+        m_canvas->sketch()->entityChanged(hit);
     }
     emit m_canvas->selectionChanged();
     m_canvas->update();
@@ -55,9 +54,9 @@ void LineState::handleMouseMove(QMouseEvent* event) {
 void LineState::handleMouseRelease(QMouseEvent* event) {
     if (m_active) {
         m_end = m_canvas->mapToWorld(event->pos());
-        auto p1 = std::make_shared<Point>(m_start.x(), m_start.y());
-        auto p2 = std::make_shared<Point>(m_end.x(), m_end.y());
-        auto line = std::make_shared<Line>(p1, p2);
+        auto p1 = m_canvas->sketch()->create<Point>(m_start.x(), m_start.y());
+        auto p2 = m_canvas->sketch()->create<Point>(m_end.x(), m_end.y());
+        auto line = m_canvas->sketch()->create<Line>(p1, p2);
         m_canvas->sketch()->addEntity(line);
         m_active = false;
         m_canvas->update();
@@ -90,8 +89,8 @@ void CircleState::handleMouseRelease(QMouseEvent* event) {
     if (m_active) {
         QPointF worldPos = m_canvas->mapToWorld(event->pos());
         double radius = std::hypot(worldPos.x() - m_center.x(), worldPos.y() - m_center.y());
-        auto center = std::make_shared<Point>(m_center.x(), m_center.y());
-        auto circle = std::make_shared<Circle>(center, radius);
+        auto center = m_canvas->sketch()->create<Point>(m_center.x(), m_center.y());
+        auto circle = m_canvas->sketch()->create<Circle>(center, radius);
         m_canvas->sketch()->addEntity(circle);
         m_active = false;
         m_canvas->update();
@@ -127,8 +126,8 @@ void EllipseState::handleMouseRelease(QMouseEvent* event) {
         QPointF worldPos = m_canvas->mapToWorld(event->pos());
         double rx = std::abs(worldPos.x() - m_center.x());
         double ry = std::abs(worldPos.y() - m_center.y());
-        auto center = std::make_shared<Point>(m_center.x(), m_center.y());
-        auto ellipse = std::make_shared<Ellipse>(center, rx, ry);
+        auto center = m_canvas->sketch()->create<Point>(m_center.x(), m_center.y());
+        auto ellipse = m_canvas->sketch()->create<Ellipse>(center, rx, ry);
         m_canvas->sketch()->addEntity(ellipse);
         m_active = false;
         m_canvas->update();
@@ -148,9 +147,9 @@ void BezierState::handleMousePress(QMouseEvent* event) {
     if (m_points.size() == 4) {
         std::vector<std::shared_ptr<Point>> pts;
         for (const auto& p : m_points) {
-            pts.push_back(std::make_shared<Point>(p.x(), p.y()));
+            pts.push_back(m_canvas->sketch()->create<Point>(p.x(), p.y()));
         }
-        auto bezier = std::make_shared<BezierCurve>(pts);
+        auto bezier = m_canvas->sketch()->create<BezierCurve>(pts);
         m_canvas->sketch()->addEntity(bezier);
         m_points.clear();
     }
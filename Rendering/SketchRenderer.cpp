@@ -0,0 +1,209 @@
+#include "SketchRenderer.h"
+#include "../GeometryEngine/Sketch.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+// Beyond this many changed boxes in one frame, they are merged into one.
+static constexpr size_t MaxDamageRects = 32;
+
+// Antialiasing bleeds up to a pixel past the geometry; keep a margin. A
+// density cell can reach a cell further.
+static constexpr int DamageMargin = 2;
+
+// Side of a tile in logical pixels, rounded up to whole density cells so
+// tiles and a full render agree on where cells fall.
+static constexpr int TileSize = 256;
+
+void SketchRenderer::setTiled(bool tiled, unsigned threads) {
+    m_tiled = tiled;
+    m_threads = threads;
+    m_image = QImage();
+    m_tiles.clear();
+    m_valid = false;
+}
+
+void SketchRenderer::paint(QPainter& painter, const Sketch& sketch, const QTransform& view, const QSize& size, qreal dpr) {
+    resize(size, dpr);
+
+    // Entities are never removed from a sketch, so fewer means another one.
+    if (!m_valid || &sketch != m_sketch || view != m_view || sketch.getEntities().size() < m_versions.size()) {
+        m_sketch = &sketch;
+        m_view = view;
+        record(sketch);
+        if (m_tiled) {
+            for (Tile& tile : m_tiles) tile.valid = false;
+        } else {
+            renderAll(sketch);
+        }
+        m_valid = true;
+    } else {
+        QRegion region = collectDamage(sketch);
+        if (m_tiled) {
+            for (Tile& tile : m_tiles) {
+                if (region.intersects(QRect(tile.origin, QSize(m_tileSize, m_tileSize)))) tile.valid = false;
+            }
+        } else if (!region.isEmpty()) {
+            renderDamage(sketch, region);
+        }
+    }
+
+    if (m_tiled) {
+        renderTiles(sketch);
+        for (const Tile& tile : m_tiles) painter.drawImage(QPointF(tile.origin), tile.image);
+    } else {
+        painter.drawImage(QPointF(0, 0), m_image);
+    }
+}
+
+void SketchRenderer::resize(const QSize& size, qreal dpr) {
+    if (!m_tiled) {
+        const QSize pixels(static_cast<int>(std::ceil(size.width() * dpr)), static_cast<int>(std::ceil(size.height() * dpr)));
+        if (m_image.size() != pixels || m_image.devicePixelRatio() != dpr) {
+            m_image = QImage(pixels, QImage::Format_ARGB32_Premultiplied);
+            m_image.setDevicePixelRatio(dpr);
+            m_valid = false;
+        }
+        m_size = size;
+        return;
+    }
+
+    const int cell = m_lod.enabled ? std::max(1, m_lod.cellPixels) : 1;
+    const int tileSize = (TileSize + cell - 1) / cell * cell;
+    if (size == m_size && tileSize == m_tileSize && dpr == m_tileRatio && !m_tiles.empty()) return;
+
+    m_size = size;
+    m_tileSize = tileSize;
+    m_tileRatio = dpr;
+    m_tiles.clear();
+    const int side = static_cast<int>(std::ceil(tileSize * dpr));
+    for (int y = 0; y < size.height(); y += tileSize) {
+        for (int x = 0; x < size.width(); x += tileSize) {
+            Tile tile;
+            tile.image = QImage(side, side, QImage::Format_ARGB32_Premultiplied);
+            tile.image.setDevicePixelRatio(dpr);
+            tile.origin = QPoint(x, y);
+            m_tiles.push_back(std::move(tile));
+        }
+    }
+    m_valid = false;
+}
+
+void SketchRenderer::record(const Sketch& sketch) {
+    const auto& entities = sketch.getEntities();
+    m_versions.resize(entities.size());
+    m_drawn.resize(entities.size());
+    for (size_t i = 0; i < entities.size(); ++i) {
+        m_versions[i] = entities[i]->version();
+        m_drawn[i] = entities[i]->drawnRect();
+    }
+}
+
+// A changed entity damages both where it was and where it is now, in
+// logical widget pixels.
+QRegion SketchRenderer::collectDamage(const Sketch& sketch) {
+    const auto& entities = sketch.getEntities();
+    std::vector<QRectF> damage;
+    auto damaged = [&](const QRectF& rect) {
+        if (damage.size() < MaxDamageRects) damage.push_back(rect);
+        else damage.back() |= rect;
+    };
+
+    for (size_t i = 0; i < m_versions.size(); ++i) {
+        const uint64_t version = entities[i]->version();
+        if (version == m_versions[i]) continue;
+        damaged(m_drawn[i]);
+        m_versions[i] = version;
+        m_drawn[i] = entities[i]->drawnRect();
+        damaged(m_drawn[i]);
+    }
+    for (size_t i = m_versions.size(); i < entities.size(); ++i) {
+        m_versions.push_back(entities[i]->version());
+        m_drawn.push_back(entities[i]->drawnRect());
+        damaged(m_drawn.back());
+    }
+
+    const QRect visible(QPoint(0, 0), m_size);
+    const int margin = DamageMargin + (m_lod.enabled ? m_lod.cellPixels : 0);
+    QRegion region;
+    for (const QRectF& rect : damage) {
+        QRect pixels = m_view.mapRect(rect).toAlignedRect().adjusted(-margin, -margin, margin, margin);
+        region += pixels & visible;
+    }
+    return region;
+}
+
+void SketchRenderer::renderAll(const Sketch& sketch) {
+    m_image.fill(Qt::transparent);
+    QPainter painter(&m_image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setTransform(m_view);
+    sketch.draw(painter, m_view.inverted().mapRect(QRectF(QPointF(0, 0), QSizeF(m_size))), m_lod);
+}
+
+// The damage is cleared and every entity reaching it is drawn again, in
+// order, so overlaps stack as in a full render.
+void SketchRenderer::renderDamage(const Sketch& sketch, const QRegion& region) {
+    QPainter painter(&m_image);
+    painter.setClipRegion(region);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    for (const QRect& rect : region) painter.fillRect(rect, Qt::transparent);
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setTransform(m_view);
+
+    // One pass over the region's box, so nothing is drawn twice where an
+    // entity spans two damaged rects; the clip keeps the rest untouched.
+    sketch.draw(painter, m_view.inverted().mapRect(QRectF(region.boundingRect())), m_lod);
+}
+
+// Dirty tiles are rendered whole, each by one worker with its own painter.
+// The caches drawing reads are built first, here, so the workers only read
+// the sketch.
+void SketchRenderer::renderTiles(const Sketch& sketch) {
+    std::vector<Tile*> dirty;
+    QRect area;
+    for (Tile& tile : m_tiles) {
+        if (tile.valid) continue;
+        dirty.push_back(&tile);
+        area |= QRect(tile.origin, QSize(m_tileSize, m_tileSize));
+    }
+    if (dirty.empty()) return;
+
+    const QTransform toWorld = m_view.inverted();
+    sketch.prepareDraw(toWorld.mapRect(QRectF(area)), Tessellation::pixelScale(m_view), m_lod);
+
+    auto renderOne = [&](Tile& tile) {
+        tile.image.fill(Qt::transparent);
+        QPainter painter(&tile.image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setTransform(m_view * QTransform::fromTranslate(-tile.origin.x(), -tile.origin.y()));
+        sketch.draw(painter, toWorld.mapRect(QRectF(tile.origin, QSizeF(m_tileSize, m_tileSize))), m_lod);
+        tile.valid = true;
+    };
+
+    unsigned threads = m_threads ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, dirty.size()));
+    if (threads <= 1) {
+        for (Tile* tile : dirty) renderOne(*tile);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < dirty.size(); i = next++) {
+            renderOne(*dirty[i]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
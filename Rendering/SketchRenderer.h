@@ -0,0 +1,73 @@
+#ifndef SKETCHRENDERER_H
+#define SKETCHRENDERER_H
+
+#include <QImage>
+#include <QPainter>
+#include <QRectF>
+#include <QRegion>
+#include <QSize>
+#include <QTransform>
+#include <cstdint>
+#include <vector>
+#include "../GeometryEngine/DrawBatch.h"
+
+class Sketch;
+
+// The sketch's committed geometry, kept rendered in an offscreen image for
+// one view transform. Each paint only re-renders the areas of entities
+// whose version changed since the last, so previews drawn on top of an
+// unchanged sketch cost one image blit.
+class SketchRenderer {
+public:
+    // Brings the image up to date and draws it at the painter's origin.
+    // view maps world to logical widget pixels; size is the widget's size.
+    void paint(QPainter& painter, const Sketch& sketch, const QTransform& view, const QSize& size, qreal dpr);
+
+    // Renders everything again on the next paint, e.g. after entities were
+    // changed in a way that does not bump their version.
+    void invalidate() { m_valid = false; }
+
+    void setLevelOfDetail(const LevelOfDetail& lod) { m_lod = lod; m_valid = false; }
+    const LevelOfDetail& levelOfDetail() const { return m_lod; }
+
+    // Splits the view into square tiles, each cached in its own image and
+    // rendered again only when damaged, with several dirty tiles rendered
+    // at once on up to threads workers (0: one per core).
+    void setTiled(bool tiled, unsigned threads = 0);
+    bool isTiled() const { return m_tiled; }
+
+private:
+    struct Tile {
+        QImage image;
+        QPoint origin; // logical widget pixels
+        bool valid = false;
+    };
+
+    QSize m_size;
+    bool m_valid = false;
+    const Sketch* m_sketch = nullptr;
+    QTransform m_view;
+    LevelOfDetail m_lod;
+
+    // Untiled, the whole view in one image.
+    QImage m_image;
+
+    bool m_tiled = false;
+    unsigned m_threads = 0;
+    int m_tileSize = 0;
+    qreal m_tileRatio = 0.0;
+    std::vector<Tile> m_tiles;
+
+    // Per entity, the version and drawnRect() as last rendered.
+    std::vector<uint64_t> m_versions;
+    std::vector<QRectF> m_drawn;
+
+    void resize(const QSize& size, qreal dpr);
+    void record(const Sketch& sketch);
+    QRegion collectDamage(const Sketch& sketch);
+    void renderAll(const Sketch& sketch);
+    void renderDamage(const Sketch& sketch, const QRegion& region);
+    void renderTiles(const Sketch& sketch);
+};
+
+#endif // SKETCHRENDERER_H
@@ -0,0 +1,54 @@
+// Headless regression checks for the geometry engine's distance queries.
+// Prints one line per failed check and exits non-zero if any failed.
+//
+//   GeometryChecks
+
+#include "../GeometryEngine/BezierCurve.h"
+#include "../GeometryEngine/Point.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    std::cout << "FAILED: " << what << '\n';
+    ++failures;
+}
+
+static std::shared_ptr<BezierCurve> cubic(double x0, double y0, double x1, double y1,
+                                          double x2, double y2, double x3, double y3) {
+    std::vector<std::shared_ptr<Point>> points = {
+        std::make_shared<Point>(x0, y0), std::make_shared<Point>(x1, y1),
+        std::make_shared<Point>(x2, y2), std::make_shared<Point>(x3, y3)};
+    return std::make_shared<BezierCurve>(points);
+}
+
+// Clicking exactly on the end of a cubic whose last two control points
+// coincide makes t = 1 a root of the distance quintic that Newton also
+// approaches from inside; it must be reported once.
+static void cubicEndpointHit() {
+    auto curve = cubic(0, 0, 1, 2, 3, 1, 3, 1);
+    check(curve->distance(QPointF(3, 1)) == 0.0, "cubic distance at P3 with P2 == P3");
+    check(curve->distance(QPointF(0, 0)) == 0.0, "cubic distance at P0");
+
+    // Every small integer curve with a doubled end, clicked on both ends.
+    for (int a = -2; a <= 2; ++a) {
+        for (int b = -2; b <= 2; ++b) {
+            for (int c = -2; c <= 2; ++c) {
+                auto doubled = cubic(0, 0, a, b, c, 1, c, 1);
+                if (doubled->distance(QPointF(c, 1)) != 0.0 || doubled->distance(QPointF(0, 0)) != 0.0) {
+                    check(false, "cubic distance at the ends of a curve with P2 == P3");
+                    return;
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    cubicEndpointHit();
+    if (failures == 0) std::cout << "all geometry checks passed\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -143,15 +143,22 @@ void MainWindow::onPropertyChanged(QTreeWidgetItem* item, int column) {
     } else if (propName == "Thickness") {
         bool ok;
         double t = val.toDouble(&ok);
-        if (ok) selectedEntity->setThickness(t);
+        if (ok) {
+            selectedEntity->setThickness(t);
+            m_sketch->entityChanged(selectedEntity);
+        }
     } else if (propName == "X" || propName == "Y" || propName == "Radius") {
         bool ok;
         double v = val.toDouble(&ok);
         if (ok) {
-            auto params = selectedEntity->getParameters();
-            if (propName == "X" && params.size() >= 1) *params[0] = v;
-            else if (propName == "Y" && params.size() >= 2) *params[1] = v;
-            else if (propName == "Radius" && selectedEntity->getType() == EntityType::Circle && params.size() >= 3) *params[2] = v;
+            double* param = nullptr;
+            if (propName == "X") param = selectedEntity->parameter(0);
+            else if (propName == "Y") param = selectedEntity->parameter(1);
+            else if (propName == "Radius" && selectedEntity->getType() == EntityType::Circle) param = selectedEntity->parameter(2);
+            if (param) {
+                *param = v;
+                m_sketch->parameterChanged(param);
+            }
         }
     }
 